@@ -0,0 +1,84 @@
+// Page allocator benchmark: fork N children that repeatedly grow
+// their heap, touch each new page and shrink it again, so every
+// round trip is a burst of kalloc()/kfree() calls spread over all
+// CPUs.  Runs once with
+// the per-CPU page caches off and once with them on.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memctl.h"
+
+#define PGSIZE  4096
+#define BATCH   32      // pages per sbrk() call
+#define ROUNDS  200
+
+int
+run(int nproc)
+{
+  int i, j, r, pid, start, ticks;
+  char *p;
+
+  start = uptime();
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "allocbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(r = 0; r < ROUNDS; r++){
+        if((p = sbrk(BATCH*PGSIZE)) == (char*)-1){
+          printf(1, "allocbench: sbrk failed\n");
+          exit();
+        }
+        // sbrk() is lazy; touch each page to allocate it.
+        for(j = 0; j < BATCH*PGSIZE; j += PGSIZE)
+          p[j] = 1;
+        sbrk(-BATCH*PGSIZE);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  ticks = uptime() - start;
+  if(ticks == 0)
+    ticks = 1;
+  return ticks;
+}
+
+void
+report(char *name, int nproc, int ticks)
+{
+  int pages;
+
+  // Each round allocates and then frees BATCH pages.
+  pages = nproc * ROUNDS * BATCH * 2;
+  printf(1, "%s: %d pages in %d ticks, %d pages/sec\n",
+         name, pages, ticks, pages * 100 / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, old, t;
+
+  nproc = 4;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(nproc < 1)
+    nproc = 1;
+
+  printf(1, "allocbench: %d allocators\n", nproc);
+  old = memctl(MC_PCP, 0);
+  t = run(nproc);
+  report("global freelist", nproc, t);
+
+  memctl(MC_PCP, 1);
+  t = run(nproc);
+  report("per-cpu caches ", nproc, t);
+
+  memctl(MC_PCP, old);
+  exit();
+}
@@ -7,8 +7,14 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  char **pages;      // B_PAGE: pages transferred instead of data
+  int npages;        // number of pages, on consecutive sectors
+  int pgxfer;        // pages moved so far (ide.c)
+  void (*iodone)(struct buf*);  // B_ASYNC: called when done
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_PAGE  0x8  // whole-page transfer to/from page, not cached
+#define B_ASYNC 0x10 // nobody waits: ideintr() calls iodone instead
 
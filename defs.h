@@ -2,6 +2,10 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct memstat;
+struct vma;
+struct kmem_cache;
+struct page;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -9,6 +13,7 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct tlbbatch;
 
 // bio.c
 void            binit(void);
@@ -54,11 +59,15 @@ void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 void swapread(char* ptr, int blkno);
 void swapwrite(char* ptr, int blkno);
+void swapreadv(char** pgs, int n, int blkno);
+void swapwritev(char** pgs, int n, int blkno);
+void swapwritev_async(struct buf*, char**, int, int, void (*)(struct buf*));
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderw_async(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -67,25 +76,61 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_nowait(void);
+char*           kalloc_zeroed(void);
+int             kzero_idle(void);
+char*           kalloc_pages(int);
+void            kfree_pages(char*, int);
+char*           hugealloc(void);
+void            hugefree(char*);
+void            hugerelease(void);
 void            kfree(char*);
+void            kfree_nocache(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 int		freemem(void);
+int		memctl(int, int);
+void		getmemstat(struct memstat*);
+void		kswapdinit(void);
 void		lru_insert(char* mem, pde_t *pgdir, char* vaddr);
-void		lru_delete(char* mem, pde_t *pgdir, char* vaddr);
+void		lru_link(struct page*, pde_t*, char*);
+void		lru_delete(struct page*);
+void		lru_unlink(struct page*);
+void		lru_rotate(struct page*);
+void		lru_activate(struct page*);
+void		lru_deactivate(struct page*);
+struct page*	pa2page(uint);
 char*		swapout(void);
-void		swapin(struct proc *p, uint);
+int		swapin(struct proc *p, uint);
 void		set_bitmap(int, int);
 int		find_bitmap(void);
+int		find_bitmap_run(int);
+void		swap_dup(int);
+void		swapcache_free(struct page*);
+void		swap_iostart(int);
+int		swap_trystart(int);
+void		swap_iodone(int);
+void		swap_iowait(int);
+int		swap_iobusy(int);
+void		swapwb_start(char**, int, int);
+int		swapwb_copy(int, char*);
+int		swapwb_wait(void);
 int		check_bitmap(int);
+void		swapinit(void);
 // kbd.c
 void            kbdintr(void);
 
+// ksm.c
+void            ksminit(void);
+int             ksmctl(int);
+void            ksmstat(struct memstat*);
+
 // lapic.c
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(int, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -104,7 +149,25 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// mmap.c
+void            mmapinit(void);
+struct vma*     mmapfind(struct proc*, uint);
+int             mmapcheck(struct proc*, uint, uint);
+int             mmappopulate(struct proc*, uint, uint);
+uint            mmap(uint, int, int, int, struct file*, int);
+int             munmap(uint);
+int             mmapfault(struct proc*, uint, uint);
+int             mmapdup(struct proc*);
+void            mmapclose(struct proc*);
+
+// slab.c
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             slabpages(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -126,6 +189,8 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(char*, void(*)(void));
+pde_t*          procpgdir(int);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
@@ -168,6 +233,12 @@ void            syscall(void);
 // timer.c
 void            timerinit(void);
 
+// tlb.c
+void            tlbinit(struct tlbbatch*);
+void            tlbadd(struct tlbbatch*, pde_t*, uint);
+void            tlbflush(struct tlbbatch*);
+void            tlbintr(void);
+
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
@@ -190,9 +261,27 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             copyuvmrange(pde_t*, pde_t*, uint, uint, int);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+void            hugesplit(pde_t*, uint, pte_t*);
+int             hugesplitrange(pde_t*, uint, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             cowfault(struct proc*, uint);
+int             lazyfault(struct proc*, uint);
+int             pgfault(struct proc*, uint, uint);
+int             uvmprefault(struct proc*, uint, uint);
+// zswap.c
+void            zswapinit(void);
+int             zswap_store(int, char*);
+int             zswap_load(int, char*);
+int             zswap_has(int);
+void            zswap_invalidate(int);
+int             zswapctl(int);
+void            zswapstat(struct memstat*);
+
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -99,9 +99,11 @@ exec(char *path, char **argv)
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->ra_n = 0;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
+  mmapclose(curproc);
   freevm(oldpgdir);
   //cprintf("end exec...\n");
   return 0;
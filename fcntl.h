@@ -2,3 +2,12 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// mmap() protection and flags
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+
+#define MAP_ANONYMOUS 0x1
+#define MAP_POPULATE  0x2
+#define MAP_SHARED    0x4
+#define MAP_HUGE      0x8
@@ -671,46 +671,76 @@ nameiparent(char *path, char *name)
   return namex(path, 1, name);
 }
 
-void swapread(char* ptr, int blkno)
+// Move n pages between pgs[] and the consecutive swap slots
+// starting at blkno as a single multi-sector disk request.
+// The pages go straight to or from the disk, so swapping does
+// not evict anything from bcache.
+static void swaprw(char** pgs, int n, int blkno, int write)
 {
-	struct buf* bp;
-	int i;
+	struct buf b;
 
 	const int BLKS_PER_PG = PGSIZE/BSIZE;
 
-	if ( blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG )
-		panic("swapread: blkno exceeded range");
+	if ( blkno < 0 || n < 1 || blkno + n > SWAPMAX / BLKS_PER_PG )
+		panic("swaprw: blkno exceeded range");
+
+	memset(&b, 0, sizeof(b));
+	initsleeplock(&b.lock, "swap");
+	acquiresleep(&b.lock);
+	b.dev = 0;
+	b.blockno = SWAPBASE + BLKS_PER_PG * blkno;
+	b.flags = B_PAGE | (write ? B_DIRTY : 0);
+	b.pages = pgs;
+	b.npages = n;
+	iderw(&b);
+	releasesleep(&b.lock);
+
+	if (write)
+		nr_sectors_write += n * BLKS_PER_PG;
+	else
+		nr_sectors_read += n * BLKS_PER_PG;
+}
 
-	for ( i=0; i < BLKS_PER_PG; ++i ) {
-		nr_sectors_read++;
-		bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-		memmove(ptr + i * BSIZE, bp->data, BSIZE);
-		brelse(bp);
-	}
+void swapread(char* ptr, int blkno)
+{
+	swaprw(&ptr, 1, blkno, 0);
 }
 
 void swapwrite(char* ptr, int blkno)
-{	//cprintf("i'm swapwrite\n");
-	struct buf* bp;
-	int i;
+{
+	swaprw(&ptr, 1, blkno, 1);
+}
 
-	const int BLKS_PER_PG = PGSIZE/BSIZE;
+// Read slots blkno..blkno+n-1 into a cluster of n pages.
+void swapreadv(char** pgs, int n, int blkno)
+{
+	swaprw(pgs, n, blkno, 0);
+}
 
-	if ( blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG )
-		panic("swapwrite: blkno exceeded range");
-
-	for ( i=0; i < BLKS_PER_PG; ++i ) {
-		nr_sectors_write++;
-		//cprintf("write : %d\n",nr_sectors_write);
-		//cprintf("swapbase : %d, BLKS_PER_PG : %d, blkno : %d\n",SWAPBASE, BLKS_PER_PG, blkno);
-		bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-		//cprintf("before memmove\n");
-		memmove(bp->data, ptr + i * BSIZE, BSIZE);
-		//cprintf("after memmove\n");
-		bwrite(bp);
-		brelse(bp);
-	}
-	//cprintf("end swapwrite\n");
+// Write a cluster of n pages to slots blkno..blkno+n-1.
+void swapwritev(char** pgs, int n, int blkno)
+{
+	swaprw(pgs, n, blkno, 1);
 }
 
+// swapwritev() without waiting: queue the write in b and return.
+// done(b) is called from the disk interrupt when it finishes;
+// b and the pages must stay put until then.
+void swapwritev_async(struct buf *b, char** pgs, int n, int blkno,
+		      void (*done)(struct buf*))
+{
+	const int BLKS_PER_PG = PGSIZE/BSIZE;
 
+	if ( blkno < 0 || n < 1 || blkno + n > SWAPMAX / BLKS_PER_PG )
+		panic("swapwritev_async: blkno exceeded range");
+
+	memset(b, 0, sizeof(*b));
+	b->dev = 0;
+	b->blockno = SWAPBASE + BLKS_PER_PG * blkno;
+	b->flags = B_PAGE | B_DIRTY | B_ASYNC;
+	b->pages = pgs;
+	b->npages = n;
+	b->iodone = done;
+	nr_sectors_write += n * BLKS_PER_PG;
+	iderw_async(b);
+}
@@ -23,6 +23,10 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+
+#define SECTORS_PER_PAGE (PGSIZE/SECTOR_SIZE)
+#define MAXPAGEIO     (256/SECTORS_PER_PAGE)  // sector count is 8 bits
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -67,6 +71,13 @@ ideinit(void)
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  // Let READ/WRITE MULTIPLE move one page per interrupt,
+  // for B_PAGE transfers to the swap area on disk 0.
+  idewait(0);
+  outb(0x1f2, SECTORS_PER_PAGE);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  idewait(0);
 }
 
 // Start the request for b.  Caller must hold idelock.
@@ -84,16 +95,31 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
+  // A B_PAGE request covers npages pages' worth of sectors
+  // starting at sector blockno, one page per DRQ block.
+  if(b->flags & B_PAGE){
+    if(b->npages < 1 || b->npages > MAXPAGEIO)
+      panic("idestart: npages");
+    sector_per_block = b->npages * SECTORS_PER_PAGE;
+    b->pgxfer = 0;
+    sector = b->blockno;
+    read_cmd = IDE_CMD_RDMUL;
+    write_cmd = IDE_CMD_WRMUL;
+  }
+
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, sector_per_block);  // number of sectors (0 = 256)
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    if(b->flags & B_PAGE)
+      outsl(0x1f0, b->pages[b->pgxfer++], PGSIZE/4);
+    else
+      outsl(0x1f0, b->data, BSIZE/4);
   } else {
     outb(0x1f7, read_cmd);
   }
@@ -104,6 +130,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  void (*iodone)(struct buf*);
 
   // First queued buffer is the active request.
   acquire(&idelock);
@@ -112,15 +139,36 @@ ideintr(void)
     release(&idelock);
     return;
   }
+
+  // A multi-page request interrupts once per page; move the
+  // next page and leave it at the head of the queue until the
+  // last one is done.
+  if(b->flags & B_PAGE){
+    if(idewait(1) < 0)
+      b->pgxfer = b->npages;  // error: give up on the rest
+    else if(!(b->flags & B_DIRTY))
+      insl(0x1f0, b->pages[b->pgxfer++], PGSIZE/4);
+    else if(b->pgxfer < b->npages){
+      outsl(0x1f0, b->pages[b->pgxfer++], PGSIZE/4);
+      release(&idelock);
+      return;
+    }
+    if(b->pgxfer < b->npages){
+      release(&idelock);
+      return;
+    }
+  }
   idequeue = b->qnext;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
+  if(!(b->flags & (B_DIRTY|B_PAGE)) && idewait(1) >= 0)
     insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
+  // Wake process waiting for this buf.  Once idelock is
+  // released a waiter may reuse b, so look at it first.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
+  iodone = (b->flags & B_ASYNC) ? b->iodone : 0;
   wakeup(b);
 
   // Start disk on next buf in queue.
@@ -128,6 +176,27 @@ ideintr(void)
     idestart(idequeue);
 
   release(&idelock);
+
+  // Completion work may take other locks, so run it last.
+  if(iodone)
+    iodone(b);
+}
+
+// Append b to idequeue, starting the disk if it was idle.
+// Caller must hold idelock.
+static void
+ideappend(struct buf *b)
+{
+  struct buf **pp;
+
+  b->qnext = 0;
+  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    ;
+  *pp = b;
+
+  // Start disk if necessary.
+  if(idequeue == b)
+    idestart(b);
 }
 
 //PAGEBREAK!
@@ -137,8 +206,6 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
-
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
@@ -147,16 +214,7 @@ iderw(struct buf *b)
     panic("iderw: ide disk 1 not present");
 
   acquire(&idelock);  //DOC:acquire-lock
-
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
-
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  ideappend(b);
 
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
@@ -166,3 +224,19 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Queue the B_ASYNC write b and return at once.  ideintr()
+// calls b->iodone(b) when the disk is done with it; until then
+// b and the memory it points at belong to the driver.
+void
+iderw_async(struct buf *b)
+{
+  if((b->flags & (B_ASYNC|B_DIRTY)) != (B_ASYNC|B_DIRTY) || b->iodone == 0)
+    panic("iderw_async");
+  if(b->dev != 0 && !havedisk1)
+    panic("iderw: ide disk 1 not present");
+
+  acquire(&idelock);
+  ideappend(b);
+  release(&idelock);
+}
@@ -1,13 +1,17 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^order contiguous pages with kalloc_pages().
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
+#include "memctl.h"
+#include "memstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file 
@@ -16,19 +20,89 @@ struct run {
   struct run *next;
 };
 
+// Buddy allocator.  Free memory is kept in blocks of 2^order
+// pages, order 0..MAXORDER, each aligned to its own size.  A free
+// block is listed on kmem.free_area[order] through the struct page
+// of its first page, whose order field is then order+1.  Freeing a
+// block merges it with its buddy -- the other half of the next
+// larger block -- for as long as the buddy is free as well.
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  int use_pcp;
+  struct page *free_area[MAXORDER+1];
+  uint nblocks[MAXORDER+1];   // free blocks of each order
+  int nfree;       // pages in the buddy free lists
 } kmem;
 
+// Per-CPU page caches.  kalloc() and kfree() work on the current
+// CPU's cache without touching kmem.lock, and move order-0 pages
+// between it and the buddy lists PCP_BATCH at a time.  Each cache sits on
+// its own cache line so CPUs don't bounce it between them.
+#define PCP_BATCH 16
+#define PCP_HIGH  (4*PCP_BATCH)
+
+struct pcp {
+  struct run *freelist;
+  int count;
+} __attribute__((aligned(64)));
+
+struct pcp pcps[NCPU];
+
+// Background reclaim.  kalloc() wakes kswapd when free memory
+// drops below kswapd.low; it then swaps pages out until there
+// are kswapd.high free pages again.  Reclaim inside kalloc()
+// itself is left for when the free list is actually empty.
+struct {
+  struct spinlock lock;
+  int low;
+  int high;
+  int pending;      // a wakeup is waiting to be handled
+  uint wakeups;
+  uint pages;       // pages swapped out by kswapd
+} kswapd;
+
+// 4 MB frames in use by MAP_HUGE mappings.  They are order
+// MAXORDER buddy blocks; a frame split up for swapping (see
+// hugesplit) stops counting here and its pieces are freed one
+// by one, to be merged again by the buddy allocator.
+struct {
+  struct spinlock lock;
+  int nused;
+  uint splits;
+} hugepool;
+
+// Pre-zeroed pages.  Idle CPUs take free pages, clear them and
+// park them here (see kzero_idle), so kalloc_zeroed() can usually
+// skip the memset.  The pool still counts as free memory, and
+// ordinary allocations fall back on it before reclaiming.
+#define ZPOOL_MAX 256
+
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int count;
+  uint hits;      // kalloc_zeroed() served from the pool
+  uint misses;    // kalloc_zeroed() had to clear a page itself
+} zpool;
+
+uint direct_reclaims;
+extern uint nr_evicted, nr_cowfaults, nr_zerofills;
+extern uint nr_tlbflushes, nr_tlbipis;
+extern uint nr_scanned, nr_refaults, nr_wsrefaults;
+extern uint nr_swapcached, nr_cleanevicts;
+extern uint nr_zeroevicts, nr_zeroins;
+extern uint nr_writeback, nr_wbfaults;
+
 struct spinlock lru_lock;
 
 struct page pages[PHYSTOP/PGSIZE];
-struct page *page_lru_head = 0;
-int num_free_pages = 0;
-int num_lru_pages = 0;
-char* bitmap;
+struct lrulist lru_active, lru_inactive;
+int num_total_pages = 0;
+int num_lru_pages = 0;  // on either list
+uint nr_activated, nr_deactivated;
+int num_swap_pages = 0;
+extern uint ra_pages, ra_hits, ra_wasted;
 
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
@@ -40,9 +114,11 @@ kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
   initlock(&lru_lock, "lru_lock");
-  //num_free_pages = 0;
+  initlock(&kswapd.lock, "kswapd");
+  initlock(&hugepool.lock, "hugepool");
+  initlock(&zpool.lock, "zpool");
+  //num_total_pages = 0;
   //num_lru_pages = 0;
-  //page_lru_head = 0;
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -52,6 +128,9 @@ kinit2(void *vstart, void *vend)
 {
   freerange(vstart, vend);
   kmem.use_lock = 1;
+  kmem.use_pcp = 1;
+  kswapd.low = num_total_pages / 64;
+  kswapd.high = num_total_pages / 32;
 }
 
 void
@@ -61,11 +140,113 @@ freerange(void *vstart, void *vend)
   p = (char*)PGROUNDUP((uint)vstart);
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE) {
     kfree(p);
-    pages[num_free_pages].vaddr = p;
-    num_free_pages++;
+    num_total_pages++;
   }
 
 }
+
+// The buddy free lists.  Callers hold kmem.lock once
+// kmem.use_lock is set.
+static void
+buddy_push(struct page *p, int order)
+{
+  p->order = order + 1;
+  p->prev = 0;
+  p->next = kmem.free_area[order];
+  if(p->next)
+    p->next->prev = p;
+  kmem.free_area[order] = p;
+  kmem.nblocks[order]++;
+}
+
+static void
+buddy_remove(struct page *p, int order)
+{
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    kmem.free_area[order] = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  p->next = 0;
+  p->prev = 0;
+  p->order = 0;
+  kmem.nblocks[order]--;
+}
+
+// Take a block of 2^order pages, splitting a larger block if
+// there is none of that size.  Returns 0 if nothing is big enough.
+static char*
+buddy_alloc(int order)
+{
+  struct page *p;
+  int o;
+
+  for(o = order; o <= MAXORDER && kmem.free_area[o] == 0; o++)
+    ;
+  if(o > MAXORDER)
+    return 0;
+  p = kmem.free_area[o];
+  buddy_remove(p, o);
+  // Hand the upper halves back to the smaller orders.
+  while(o > order){
+    o--;
+    buddy_push(p + (1 << o), o);
+  }
+  kmem.nfree -= 1 << order;
+  return P2V((p - pages) << PGSHIFT);
+}
+
+// Free a block of 2^order pages, merging it with its buddies.
+static void
+buddy_free(char *v, int order)
+{
+  uint pfn, bpfn;
+
+  kmem.nfree += 1 << order;
+  pfn = V2P(v) >> PGSHIFT;
+  for(; order < MAXORDER; order++){
+    bpfn = pfn ^ (1 << order);
+    if(bpfn >= PHYSTOP/PGSIZE || pages[bpfn].order != order + 1)
+      break;
+    buddy_remove(&pages[bpfn], order);
+    pfn &= ~(1 << order);
+  }
+  buddy_push(&pages[pfn], order);
+}
+
+// Move up to n pages from the buddy lists into c.
+// Caller must have interrupts off.
+static void
+pcp_refill(struct pcp *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = (struct run*)buddy_alloc(0)) != 0){
+    r->next = c->freelist;
+    c->freelist = r;
+    c->count++;
+  }
+  release(&kmem.lock);
+}
+
+// Return n pages from c to the buddy lists.
+// Caller must have interrupts off.
+static void
+pcp_drain(struct pcp *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->count--;
+    buddy_free((char*)r, 0);
+  }
+  release(&kmem.lock);
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -75,129 +256,533 @@ void
 kfree(char *v)
 {
   struct run *r;
+  struct pcp *c;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  swapcache_free(pa2page(V2P(v)));
 
-  // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+  r = (struct run*)v;
+  if(kmem.use_lock){
+    pushcli();
+    c = &pcps[cpuid()];
+    if(kmem.use_pcp){
+      r->next = c->freelist;
+      c->freelist = r;
+      if(++c->count > PCP_HIGH)
+        pcp_drain(c, PCP_BATCH);
+      popcli();
+      return;
+    }
+    if(c->count)
+      pcp_drain(c, c->count);
+    popcli();
+  }
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  buddy_free((char*)r, 0);
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
+// kfree() straight to the shared free lists, past this CPU's
+// cache.  For pages freed by interrupt handlers, e.g. when a
+// swap write completes, which some other CPU is waiting for.
+void
+kfree_nocache(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kfree");
+  swapcache_free(pa2page(V2P(v)));
+
+  acquire(&kmem.lock);
+  buddy_free(v, 0);
+  release(&kmem.lock);
+}
+
+// Free the block of 2^order pages at v, which must have come
+// from kalloc_pages(order).
+void
+kfree_pages(char *v, int order)
+{
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+  if(order < 0 || order > MAXORDER || V2P(v) % (PGSIZE << order) ||
+     v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_pages");
+  acquire(&kmem.lock);
+  buddy_free(v, order);
+  release(&kmem.lock);
+}
+
+static void
+kswapd_wake(void)
+{
+  acquire(&kswapd.lock);
+  if(!kswapd.pending){
+    kswapd.pending = 1;
+    wakeup(&kswapd);
+  }
+  release(&kswapd.lock);
+}
+
+static void
+kswapd_main(void)
+{
+  uint before;
+  char *r;
+
+  for(;;){
+    acquire(&kswapd.lock);
+    while(!kswapd.pending)
+      sleep(&kswapd, &kswapd.lock);
+    kswapd.pending = 0;
+    kswapd.wakeups++;
+    release(&kswapd.lock);
+
+    // Pages being written to swap will be free shortly.
+    while(freemem() + nr_writeback < kswapd.high){
+      before = nr_evicted;
+      if((r = swapout()) != 0)
+        kfree(r);
+      else if(nr_evicted == before)
+        break;
+      kswapd.pages += nr_evicted - before;
+    }
+  }
+}
+
+void
+kswapdinit(void)
+{
+  kthread("kswapd", kswapd_main);
+}
+
+// Allocate one 4096-byte page of physical memory if one is
+// free right now, without reclaiming anything.  Takes no lock
+// above kmem.lock and zpool.lock, and in particular does not wake
+// kswapd (wakeup() takes ptable.lock), so it is safe to call with
+// lru_lock or zswap.lock held; kalloc() does the waking.
+// Returns 0 if the free lists are empty.
+char*
+kalloc_nowait(void)
+{
+  struct run *r;
+  struct pcp *c;
+
+  if (kmem.use_lock) {
+    pushcli();
+    c = &pcps[cpuid()];
+    r = 0;
+    if (kmem.use_pcp) {
+      if (c->count == 0)
+        pcp_refill(c, PCP_BATCH);
+      if ((r = c->freelist) != 0) {
+        c->freelist = r->next;
+        c->count--;
+      }
+    } else if (c->count) {
+      pcp_drain(c, c->count);
+    }
+    popcli();
+    if (r == 0) {
+      acquire(&kmem.lock);
+      r = (struct run*)buddy_alloc(0);
+      release(&kmem.lock);
+    }
+    if (r == 0 && zpool.count > 0) {
+      acquire(&zpool.lock);
+      if ((r = zpool.list) != 0) {
+        zpool.list = r->next;
+        zpool.count--;
+      }
+      release(&zpool.lock);
+    }
+    return (char*)r;
+  }
+
+  return buddy_alloc(0);
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 char*
 kalloc(void)
 {
-  struct run *r;
-//try_again:
+  char *r;
+  int inflight;
+
+  if ((r = kalloc_nowait()) != 0) {
+    if (kmem.use_lock && freemem() < kswapd.low && !kswapd.pending)
+      kswapd_wake();
+    return r;
+  }
 
   if (kmem.use_lock)
+	kswapd_wake();
+  direct_reclaims++;
+  // Evicted pages that have to be written are only freed when
+  // the write completes; wait for one if nothing else came free.
+  // The writes may even have finished before we get to wait, so
+  // look at the free lists before giving up.
+  while ((r = swapout()) == 0) {
+	inflight = swapwb_wait() == 0;
+	if ((r = kalloc_nowait()) != 0)
+		break;
+	if (!inflight) {
+		cprintf("OOM ERROR\n");
+		return 0;
+	}
+  }
+  return r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size.  Does not reclaim: returns 0 if no free block is
+// big enough.
+char*
+kalloc_pages(int order)
+{
+  struct pcp *c;
+  char *r;
+
+  if (order == 0)
+    return kalloc();
+  if (order < 0 || order > MAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  r = buddy_alloc(order);
+  release(&kmem.lock);
+  if (r == 0) {
+    // Pages parked in this CPU's cache may complete a block.
+    pushcli();
+    c = &pcps[cpuid()];
+    if (c->count)
+      pcp_drain(c, c->count);
+    popcli();
     acquire(&kmem.lock);
+    r = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+  if (freemem() < kswapd.low && !kswapd.pending)
+    kswapd_wake();
+  return r;
+}
 
-  r = kmem.freelist;
-//  if(!r && reclaim())
-//	  goto try_again;
+// Allocate one zero-filled page, from the pre-zeroed pool if
+// it has one.  Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+  char *v;
+
+  r = 0;
+  if (kmem.use_lock && zpool.count > 0) {
+    acquire(&zpool.lock);
+    if ((r = zpool.list) != 0) {
+      zpool.list = r->next;
+      zpool.count--;
+      zpool.hits++;
+    }
+    release(&zpool.lock);
+  }
   if (r) {
-    kmem.freelist = r->next;
+    r->next = 0;    // the only word the list wrote
+    return (char*)r;
+  }
+  if ((v = kalloc()) == 0)
+    return 0;
+  memset(v, 0, PGSIZE);
+  zpool.misses++;
+  return v;
+}
 
-  } else if (!r) {
-	if (kmem.use_lock)
-		release(&kmem.lock);
-	r = (struct run*)swapout();
-	if (!r) {
-		cprintf("OOM ERROR\n");
-		return 0; 
-	}
-	return (char*)r;	  		  
+// Called from the scheduler when there is nothing to run: clear
+// one free page into the pre-zeroed pool, unless the pool is full
+// or memory is short.  Returns 1 if a page was added.
+int
+kzero_idle(void)
+{
+  struct run *r;
+
+  if (!kmem.use_lock || zpool.count >= ZPOOL_MAX || freemem() <= kswapd.high)
+    return 0;
+  if ((r = (struct run*)kalloc_nowait()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  acquire(&zpool.lock);
+  r->next = zpool.list;
+  zpool.list = r;
+  zpool.count++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// Allocate a 4 MB frame for a large page.
+// Returns 0 if there is no free 4 MB block.
+char*
+hugealloc(void)
+{
+  char *r;
+
+  if ((r = kalloc_pages(HUGEORDER)) != 0) {
+    acquire(&hugepool.lock);
+    hugepool.nused++;
+    release(&hugepool.lock);
   }
-	   
-  if (kmem.use_lock)
-    release(&kmem.lock);
-  
-  return (char*)r;
+  return r;
 }
 
+// Free a 4 MB frame that is still in one piece.
+void
+hugefree(char *v)
+{
+  acquire(&hugepool.lock);
+  hugepool.nused--;
+  release(&hugepool.lock);
+  kfree_pages(v, HUGEORDER);
+}
+
+// A mapped large page has been split into 4 KB pages; they
+// will be freed one at a time.
+void
+hugerelease(void)
+{
+  acquire(&hugepool.lock);
+  hugepool.nused--;
+  hugepool.splits++;
+  release(&hugepool.lock);
+}
+
+// Number of free pages, including those parked in the
+// per-CPU caches and the pre-zeroed pool.  Reads the counters
+// without locking, so the result is a snapshot that may be off
+// by a batch.
 int
 freemem(void) {
-	struct run *r;
-	int pnum = 0;
-
-	if (kmem.use_lock)
-		acquire(&kmem.lock);
-	
-	r = kmem.freelist;
-	if (r) {
-		while (r->next != 0) {
-			pnum += 1;
-			r = r->next;
-			}
-		}
-	
-	if (kmem.use_lock)
-		release(&kmem.lock);
-	
+	int pnum;
+
+	pnum = kmem.nfree + zpool.count;
+	for (int i = 0; i < ncpu; i++)
+		pnum += pcps[i].count;
 	return pnum;
 	}
 
+// Fill in the page counts of st.  Swap I/O counters are
+// left for the caller (see sys_memstat).
+void
+getmemstat(struct memstat *st) {
+	int i;
 
+	st->total = num_total_pages;
+	st->free = freemem();
+	st->lru = num_lru_pages;
+	st->active = lru_active.n;
+	st->inactive = lru_inactive.n;
+	st->swapped = num_swap_pages;
+	st->slab = slabpages();
+	st->zeroed = zpool.count;
+	st->zerohits = zpool.hits;
+	st->zeromisses = zpool.misses;
+	for (i = 0; i <= MAXORDER; i++)
+		st->freeblocks[i] = kmem.nblocks[i];
+	st->hugefree = kmem.nblocks[HUGEORDER];
+	st->hugeused = hugepool.nused;
+	st->hugesplits = hugepool.splits;
+	// A mapped large page is one LRU entry for 1024 pages.
+	st->kernel = st->total - st->free - st->lru -
+	    st->hugeused * (HUGEPGSIZE/PGSIZE - 1);
+	st->rapages = ra_pages;
+	st->rahits = ra_hits;
+	st->rawasted = ra_wasted;
+	st->evicted = nr_evicted;
+	st->directreclaim = direct_reclaims;
+	st->kswapdwakeups = kswapd.wakeups;
+	st->kswapdpages = kswapd.pages;
+	st->cowfaults = nr_cowfaults;
+	st->zerofills = nr_zerofills;
+	st->lowmark = kswapd.low;
+	st->highmark = kswapd.high;
+	st->tlbflushes = nr_tlbflushes;
+	st->tlbipis = nr_tlbipis;
+	st->scanned = nr_scanned;
+	st->activated = nr_activated;
+	st->deactivated = nr_deactivated;
+	st->refaults = nr_refaults;
+	st->wsrefaults = nr_wsrefaults;
+	st->swapcached = nr_swapcached;
+	st->cleanevicts = nr_cleanevicts;
+	st->zeroevicts = nr_zeroevicts;
+	st->zeroins = nr_zeroins;
+	st->writeback = nr_writeback;
+	st->wbfaults = nr_wbfaults;
+	zswapstat(st);
+	ksmstat(st);
+	}
+
+// Get or set an allocator tunable; val < 0 only queries it.
+// Returns the previous value, or -1 for an unknown cmd.
+int
+memctl(int cmd, int val)
+{
+	int old;
+
+	switch (cmd) {
+	case MC_PCP:
+		old = kmem.use_pcp;
+		if (val >= 0)
+			kmem.use_pcp = (val != 0);
+		return old;
+	case MC_LOWMARK:
+		old = kswapd.low;
+		if (val >= 0) {
+			kswapd.low = val;
+			if (kswapd.high < val)
+				kswapd.high = val;
+		}
+		return old;
+	case MC_ZSWAP:
+		return zswapctl(val);
+	case MC_KSM:
+		return ksmctl(val);
+	case MC_HIGHMARK:
+		old = kswapd.high;
+		if (val >= 0) {
+			kswapd.high = val;
+			if (kswapd.low > val)
+				kswapd.low = val;
+		}
+		return old;
+	}
+	return -1;
+}
+
+
+// Return the descriptor of the physical page at pa.
+// pages[] is indexed by page frame number, so this is O(1).
+struct page*
+pa2page(uint pa)
+{
+	if (pa >= PHYSTOP)
+		panic("pa2page");
+	return &pages[pa >> PGSHIFT];
+}
+
+// User pages live on two lists.  A new page goes on the
+// inactive list; reclaim (swapout) evicts from the inactive
+// tail and promotes pages referenced twice there to the active
+// list, whose tail is aged back onto the inactive list when the
+// active list outgrows it.  See swapout() in vm.c.
+
+// Add p at the head of l.
+static void
+list_add(struct lrulist *l, struct page *p) {
+	if (l->n == 0) {
+		p->prev = p;
+		p->next = p;
+	} else {
+		p->prev = l->head->prev;
+		l->head->prev->next = p;
+		l->head->prev = p;
+		p->next = l->head;
+	}
+	l->head = p;
+	l->n++;
+}
+
+// Take p off l.
+static void
+list_del(struct lrulist *l, struct page *p) {
+	if (l->n == 1) {
+		l->head = 0;
+	} else {
+		p->prev->next = p->next;
+		p->next->prev = p->prev;
+		if (l->head == p)
+			l->head = p->next;
+	}
+	p->prev = 0;
+	p->next = 0;
+	l->n--;
+}
+
+static struct lrulist*
+lru_list(struct page *p) {
+	return (p->flags & PG_ACTIVE) ? &lru_active : &lru_inactive;
+}
+
+// Put the user page mem, mapped at vaddr in pgdir, at the head
+// of the inactive list.  A page already on a list is left alone.
 void
 lru_insert(char* mem, pde_t *pgdir, char* vaddr) {
-	for (int n = 0; n < PHYSTOP / PGSIZE; n++) {
-		if (pages[n].vaddr == mem && pages[n].pgdir == 0) {
-			acquire(&lru_lock);
-			pages[n].vaddr = vaddr;
-			pages[n].pgdir = pgdir;
-
-			if (num_lru_pages == 0) {
-				pages[n].prev = &pages[n];
-				pages[n].next = &pages[n];
-				page_lru_head = &pages[n];
-			} else {
-				pages[n].prev = page_lru_head->prev;
-				page_lru_head->prev->next =&pages[n];
-				page_lru_head->prev = &pages[n];
-				pages[n].next = page_lru_head;	
-				page_lru_head = &pages[n];
-			}
-			num_lru_pages++;
-			release(&lru_lock);
-			break;
-		}	
-	}	
-}
-
-void
-lru_delete(char* mem, pde_t *pgdir, char* vaddr) {
-	for (int n = 0; n < PHYSTOP / PGSIZE; n++) {
-		if (pages[n].vaddr == vaddr && pages[n].pgdir == pgdir) {
-			acquire(&lru_lock);
-			pages[n].vaddr = mem;
-			pages[n].pgdir = 0;	
-		
-		
-			if (num_lru_pages == 1) {
-				pages[n].prev = 0;
-				pages[n].next = 0;
-				page_lru_head = 0;
-			} else {
-				pages[n].prev->next = pages[n].next;
-				pages[n].next->prev = pages[n].prev;
-				pages[n].prev = 0;
-				pages[n].next = 0;
-			}
-			num_lru_pages--;
-			release(&lru_lock);
-			break;
-		}
-	}	
-		
+	acquire(&lru_lock);
+	lru_link(pa2page(V2P(mem)), pgdir, vaddr);
+	release(&lru_lock);
+}
+
+// lru_insert() for callers that hold lru_lock.
+void
+lru_link(struct page *p, pde_t *pgdir, char* vaddr) {
+	if (p->pgdir != 0)
+		return;
+	p->vaddr = vaddr;
+	p->pgdir = pgdir;
+	p->flags = 0;
+	list_add(&lru_inactive, p);
+	num_lru_pages++;
+}
+
+// Take page descriptor p off the LRU lists.
+// Caller must hold lru_lock.
+void
+lru_unlink(struct page *p) {
+	if (p->pgdir == 0)
+		return;
+	list_del(lru_list(p), p);
+	p->pgdir = 0;
+	p->vaddr = 0;
+	p->flags = 0;
+	num_lru_pages--;
+}
+
+// Move p to the head of the list it is on.
+// Caller must hold lru_lock.
+void
+lru_rotate(struct page *p) {
+	struct lrulist *l = lru_list(p);
+
+	list_del(l, p);
+	list_add(l, p);
+}
+
+// Move p to the head of the active list.
+// Caller must hold lru_lock.
+void
+lru_activate(struct page *p) {
+	list_del(lru_list(p), p);
+	p->flags = PG_ACTIVE;
+	list_add(&lru_active, p);
+	nr_activated++;
+}
+
+// Move active page p to the head of the inactive list.
+// Caller must hold lru_lock.
+void
+lru_deactivate(struct page *p) {
+	list_del(&lru_active, p);
+	p->flags = 0;
+	list_add(&lru_inactive, p);
+	nr_deactivated++;
+}
+
+void
+lru_delete(struct page *p) {
+	acquire(&lru_lock);
+	lru_unlink(p);
+	release(&lru_lock);
 }
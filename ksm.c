@@ -0,0 +1,231 @@
+// Same-page merging.
+//
+// Forked workers running the same program end up with many
+// frames of identical content: pages each of them wrote with the
+// same data, zeroed heap, tables built the same way.  ksmd walks
+// pages[] a few pages at a time, hashes each page on the LRU and
+// looks the hash up in a table of pages seen before.  When two
+// pages match, both are made read-only and compared; if they are
+// still equal, the first is remapped to the second's frame and
+// its own frame is freed.  The shared frame is then counted in
+// struct page's refcnt exactly like a page after fork, so a
+// write to any of its mappings gets a private copy in cowfault().
+//
+// A page whose hash changed since ksmd last saw it is being
+// written and is left alone until it settles.  Only pages with a
+// single mapping are merged into another frame, and 4 MB pages
+// are skipped.  The scanner is off until memctl(MC_KSM, n) has
+// it hash n pages every KSM_INTERVAL ticks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "memstat.h"
+#include "tlb.h"
+
+#define KSM_INTERVAL 10                   // ticks between passes
+#define KSM_HASH     1024                 // hash table entries
+#define NFRAMES      (PHYSTOP/PGSIZE)
+
+extern struct spinlock lru_lock;
+extern struct page pages[];
+
+// Only ksmd touches this, except scan, which memctl() sets.
+static struct {
+  int scan;                       // pages hashed per pass; 0 = off
+  uint cursor;                    // next frame to look at
+  struct page *tab[KSM_HASH];     // last page seen with each hash
+  uint scanned;                   // pages hashed
+  uint merged;                    // frames freed by merging
+  uint sweeps;                    // passes over all of memory
+  uint kc;                        // time spent, in 1024-cycle units
+} ksm;
+
+static uint
+ksm_hash(char *mem)
+{
+  uint *w = (uint*)mem;
+  uint h = 2166136261U;
+  int i;
+
+  for(i = 0; i < PGSIZE/4; i++)
+    h = (h ^ w[i]) * 16777619U;
+  return h;
+}
+
+// The PTE mapping pg, or 0 if pg is no longer a 4 KB user page
+// on the LRU.  Caller must hold lru_lock, which keeps the page
+// table alive while pg is on the LRU.
+static pte_t*
+ksm_pte(struct page *pg)
+{
+  pte_t *pte;
+
+  if(pg->pgdir == 0 || (pg->pgdir[PDX(pg->vaddr)] & PTE_PS))
+    return 0;
+  if((pte = walkpgdir(pg->pgdir, pg->vaddr, 0)) == 0)
+    return 0;
+  if(!(*pte & PTE_P) || PTE_ADDR(*pte) != (pg - pages) << PGSHIFT)
+    return 0;
+  return pte;
+}
+
+// Make the page at pte copy-on-write if it is writable.
+// Caller must hold lru_lock.  The CPU may set PTE_D meanwhile,
+// so swap the entry atomically.
+static void
+ksm_protect(struct page *pg, pte_t *pte, struct tlbbatch *b)
+{
+  pte_t old;
+
+  do {
+    old = *pte;
+    if(!(old & PTE_W))
+      return;
+  } while(cmpxchg(pte, old, (old & ~PTE_W) | PTE_COW) != old);
+  tlbadd(b, pg->pgdir, (uint)pg->vaddr);
+}
+
+// Replace page p by q if they hold the same bytes.
+// Returns 1 if p's frame was freed.
+static int
+ksm_merge(struct page *p, struct page *q)
+{
+  struct tlbbatch b;
+  pte_t *pp, *pq, old;
+  pde_t *pgdir;
+  char *va;
+  uint pa;
+
+  // Nobody may write either frame while we compare them.
+  tlbinit(&b);
+  acquire(&lru_lock);
+  if(p->refcnt > 1 || (pp = ksm_pte(p)) == 0 || (pq = ksm_pte(q)) == 0){
+    release(&lru_lock);
+    return 0;
+  }
+  ksm_protect(p, pp, &b);
+  ksm_protect(q, pq, &b);
+  release(&lru_lock);
+  tlbflush(&b);
+
+  // A write fault may have made one writable again, and either
+  // may have been evicted or freed.
+  acquire(&lru_lock);
+  if(p->refcnt > 1 || (pp = ksm_pte(p)) == 0 || (pq = ksm_pte(q)) == 0 ||
+     (*pp & PTE_W) || (*pq & PTE_W)){
+    release(&lru_lock);
+    return 0;
+  }
+  old = *pp;
+  pa = PTE_ADDR(old);
+  if(memcmp(P2V(pa), P2V(PTE_ADDR(*pq)), PGSIZE) != 0){
+    release(&lru_lock);
+    return 0;
+  }
+  // Only swap in q's frame if p's PTE is still the one checked
+  // above; the CPU may have set PTE_A since.
+  if(cmpxchg(pp, old, PTE_ADDR(*pq) | PTE_FLAGS(old)) != old){
+    release(&lru_lock);
+    return 0;
+  }
+  q->refcnt = (q->refcnt ? q->refcnt : 1) + 1;
+  // p's PTE has no PTE_D for q's frame, so if q's mapping goes
+  // away and p's is adopted, swapout() would drop the frame as
+  // clean against q's slot, which may be stale.  Drop the slot.
+  swapcache_free(q);
+  pgdir = p->pgdir;
+  va = p->vaddr;
+  lru_unlink(p);
+  p->refcnt = 0;
+  ksm.merged++;
+  release(&lru_lock);
+
+  tlbadd(&b, pgdir, (uint)va);
+  tlbflush(&b);
+  kfree(P2V(pa));
+  return 1;
+}
+
+// Hash the next ksm.scan pages on the LRU and merge the ones
+// that match a page seen earlier.
+static void
+ksm_pass(void)
+{
+  struct page *p, *q;
+  pde_t *pgdir;
+  uint t0, sum, looked;
+  int n;
+
+  t0 = rdtsc();
+  n = 0;
+  for(looked = 0; n < ksm.scan && looked < NFRAMES; looked++){
+    p = &pages[ksm.cursor];
+    if(++ksm.cursor == NFRAMES){
+      ksm.cursor = 0;
+      ksm.sweeps++;
+    }
+    // Unlocked peeks; ksm_merge() checks again.
+    if((pgdir = p->pgdir) == 0 || p->refcnt > 1 ||
+       (pgdir[PDX(p->vaddr)] & PTE_PS))
+      continue;
+    n++;
+    sum = ksm_hash(P2V((p - pages) << PGSHIFT));
+    if(sum != p->ksmsum){
+      p->ksmsum = sum;
+      continue;
+    }
+    q = ksm.tab[sum % KSM_HASH];
+    if(q && q != p && q->ksmsum == sum && ksm_merge(p, q))
+      continue;
+    ksm.tab[sum % KSM_HASH] = p;
+  }
+  ksm.scanned += n;
+  ksm.kc += (rdtsc() - t0) >> 10;
+}
+
+static void
+ksmd_main(void)
+{
+  uint t0;
+
+  for(;;){
+    acquire(&tickslock);
+    t0 = ticks;
+    while(ticks - t0 < KSM_INTERVAL)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    if(ksm.scan > 0)
+      ksm_pass();
+  }
+}
+
+void
+ksminit(void)
+{
+  kthread("ksmd", ksmd_main);
+}
+
+int
+ksmctl(int val)
+{
+  int old;
+
+  old = ksm.scan;
+  if(val >= 0)
+    ksm.scan = val;
+  return old;
+}
+
+void
+ksmstat(struct memstat *st)
+{
+  st->ksmscanned = ksm.scanned;
+  st->ksmmerged = ksm.merged;
+  st->ksmsweeps = ksm.sweeps;
+  st->ksmkc = ksm.kc;
+}
@@ -0,0 +1,168 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+#include "memctl.h"
+
+#define PGSIZE   4096
+#define NWORKER  4
+#define NPAGES   64
+
+static int ready[2], go[2];
+
+static int
+pattern(int i)
+{
+	return (i / PGSIZE) % 2 ? i % 251 : 0;
+}
+
+// Tell the parent this step is done and wait for the next.
+static void
+step(void)
+{
+	char c;
+
+	write(ready[1], "r", 1);
+	read(go[0], &c, 1);
+}
+
+static void
+check(int w, char *p, int own, char *what)
+{
+	int i, want;
+
+	for (i = 0; i < NPAGES * PGSIZE; i++) {
+		want = own && i % PGSIZE == 0 ? w + 1 : pattern(i);
+		if ((uchar)p[i] != want) {
+			printf(1, "worker %d: page %d %s\n", w, i / PGSIZE, what);
+			exit();
+		}
+	}
+}
+
+static void
+worker(int w)
+{
+	char *p;
+	int i, sum;
+
+	// Private contents first, so that they are swapped out...
+	p = sbrk(NPAGES * PGSIZE);
+	for (i = 0; i < NPAGES * PGSIZE; i++)
+		p[i] = w + 1;
+	step();
+	// ...and read back in with their slots kept in the swap
+	// cache.  Overwriting them leaves those slots stale.
+	sum = 0;
+	for (i = 0; i < NPAGES * PGSIZE; i += PGSIZE)
+		sum += p[i];
+	if (sum != NPAGES * (w + 1)) {
+		printf(1, "worker %d: private pages lost in swap\n", w);
+		exit();
+	}
+	for (i = 0; i < NPAGES * PGSIZE; i++)
+		p[i] = pattern(i);
+	step();
+	check(w, p, 0, "changed");
+	// Half the workers unshare their pages; the others keep the
+	// merged frames, which are then swapped out and back in.
+	if (w % 2 == 0) {
+		for (i = 0; i < NPAGES * PGSIZE; i += PGSIZE)
+			p[i] = w + 1;
+		check(w, p, 1, "not private");
+	}
+	step();
+	check(w, p, w % 2 == 0, "lost in swap");
+	exit();
+}
+
+// Touch more pages than are free, pushing the idle workers' heaps
+// out to swap.
+static void
+pressure(void)
+{
+	struct memstat st;
+	char *p;
+	int i, n;
+
+	memstat(&st);
+	n = (st.free + 1024) * PGSIZE;
+	if (fork() == 0) {
+		if ((p = sbrk(n)) == (char*)-1)
+			exit();
+		for (i = 0; i < n; i += PGSIZE)
+			p[i] = 1;
+		exit();
+	}
+	wait();
+}
+
+// Wait for n workers to finish a step.
+static void
+collect(int n)
+{
+	char c;
+
+	while (n-- > 0)
+		read(ready[0], &c, 1);
+}
+
+// Start n workers on their next step.
+static void
+resume(int n)
+{
+	while (n-- > 0)
+		write(go[1], "g", 1);
+}
+
+// Forks workers that each build the same heap, lets ksmd merge
+// the copies, then has every other worker write its own pages
+// back.  Swapping before and after the merge checks that a merged
+// frame isn't dropped against a swap slot of stale contents.
+int
+main(int argc, char *argv[])
+{
+	int i, w, old, pid;
+	struct memstat st0, st1, st2;
+
+	old = memctl(MC_KSM, 512);
+	if (pipe(ready) < 0 || pipe(go) < 0) {
+		printf(1, "ksmtest: pipe failed\n");
+		exit();
+	}
+	for (w = 0; w < NWORKER; w++) {
+		pid = fork();
+		if (pid < 0) {
+			printf(1, "ksmtest: fork failed\n");
+			break;
+		}
+		if (pid == 0)
+			worker(w);
+	}
+	collect(w);
+	pressure();
+	resume(w);
+	collect(w);
+
+	memstat(&st0);
+	sleep(300);
+	memstat(&st1);
+	resume(w);
+	collect(w);
+	pressure();
+	resume(w);
+	for (i = 0; i < w; i++)
+		wait();
+	memstat(&st2);
+	memctl(MC_KSM, old);
+
+	printf(1, "ksm: %d pages merged, %d scanned in %d kilocycles, %d sweeps\n",
+		st1.ksmmerged - st0.ksmmerged, st1.ksmscanned - st0.ksmscanned,
+		st1.ksmkc - st0.ksmkc, st1.ksmsweeps - st0.ksmsweeps);
+	printf(1, "free pages: %d before, %d merged; %d unshared by writes\n",
+		st0.free, st1.free, st2.cowfaults - st1.cowfaults);
+	if (st1.ksmmerged == st0.ksmmerged)
+		printf(1, "ksmtest: FAILED, nothing was merged\n");
+	exit();
+}
@@ -30,10 +30,16 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  pipeinit();      // pipe cache
+  mmapinit();      // mmap area cache
   ideinit();       // disk 
+  swapinit();      // swap slot allocator
+  zswapinit();     // compressed swap pool
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  kswapdinit();    // background page reclaim
+  ksminit();       // same-page merging
   mpmain();        // finish this processor's setup
 }
 
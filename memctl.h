@@ -0,0 +1,6 @@
+// Commands for the memctl() system call.
+#define MC_PCP        1   // per-CPU page caches in kalloc (0 = off)
+#define MC_LOWMARK    2   // wake kswapd below this many free pages
+#define MC_HIGHMARK   3   // kswapd reclaims up to this many free pages
+#define MC_ZSWAP      4   // pages for the compressed swap pool (0 = off)
+#define MC_KSM        5   // pages ksmd hashes per pass (0 = off)
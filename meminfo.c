@@ -0,0 +1,53 @@
+// Print the kernel's memory statistics, including how free
+// memory is split among buddy block sizes.
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  int i, big;
+
+  if(memstat(&st) < 0){
+    printf(2, "meminfo: memstat failed\n");
+    exit();
+  }
+  printf(1, "total %d  free %d  lru %d  kernel %d  swapped %d\n",
+         st.total, st.free, st.lru, st.kernel, st.swapped);
+  printf(1, "lru: %d active, %d inactive\n", st.active, st.inactive);
+  printf(1, "reclaim: %d scanned, %d evicted, %d activated, %d deactivated\n",
+         st.scanned, st.evicted, st.activated, st.deactivated);
+  printf(1, "refaults: %d, %d of them working set\n",
+         st.refaults, st.wsrefaults);
+  printf(1, "swap cache: %d pages, %d evicted without a write\n",
+         st.swapcached, st.cleanevicts);
+  printf(1, "zero pages: %d evicted, %d faulted back\n",
+         st.zeroevicts, st.zeroins);
+  printf(1, "writeback: %d pages in flight, %d faults served from memory\n",
+         st.writeback, st.wbfaults);
+  if(st.zswappages)
+    printf(1, "zswap: %d pages compressed to %d bytes in %d pool pages\n",
+           st.zswapstored, st.zswapbytes, st.zswappages);
+  if(st.ksmscanned)
+    printf(1, "ksm: %d pages merged, %d scanned in %d kilocycles\n",
+           st.ksmmerged, st.ksmscanned, st.ksmkc);
+  printf(1, "large pages: %d mapped, %d split\n",
+         st.hugeused, st.hugesplits);
+  printf(1, "tlb shootdowns: %d, %d IPIs\n", st.tlbflushes, st.tlbipis);
+
+  printf(1, "free blocks by order:");
+  for(i = 0; i <= MAXORDER; i++)
+    printf(1, " %d", st.freeblocks[i]);
+  printf(1, "\n");
+
+  // Share of free memory not in a largest-order block, in percent.
+  big = st.freeblocks[MAXORDER] * (1 << MAXORDER);
+  if(st.free > 0)
+    printf(1, "fragmentation: %d%%\n", (st.free - big) * 100 / st.free);
+  exit();
+}
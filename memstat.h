@@ -0,0 +1,61 @@
+// Memory statistics returned by the memstat() system call.
+// Page counts are in 4096-byte pages.  Include param.h first,
+// for MAXORDER.
+struct memstat {
+  uint total;      // pages managed by kalloc
+  uint free;       // pages on the free lists
+  uint lru;        // user pages on the LRU lists
+  uint active;     // of which on the active list
+  uint inactive;   // and on the inactive list
+  uint kernel;     // everything else: page tables, stacks, slabs...
+  uint slab;       // pages holding small kernel objects (pipes, files...)
+  uint swapped;    // pages held in the swap area
+  uint swapread;   // sectors read from swap
+  uint swapwrite;  // sectors written to swap
+  uint rapages;    // pages brought in by swap readahead
+  uint rahits;     // readahead pages used before the next fault
+  uint rawasted;   // readahead pages that were not
+  uint evicted;    // pages swapped out
+  uint directreclaim; // swapout() calls from kalloc() itself
+  uint kswapdwakeups; // times kswapd woke up
+  uint kswapdpages;   // pages swapped out by kswapd
+  uint cowfaults;  // copy-on-write pages copied on a write fault
+  uint zerofills;  // lazily allocated heap pages touched
+  uint freeblocks[MAXORDER+1]; // free blocks of 2^i pages, i = 0..MAXORDER
+  uint hugefree;   // free 4 MB blocks
+  uint hugeused;   // 4 MB frames mapped by MAP_HUGE areas
+  uint hugesplits; // large pages split into 4 KB pages to swap them
+  uint zeroed;     // free pages already zeroed by idle CPUs
+  uint zerohits;   // kalloc_zeroed() calls served from them
+  uint zeromisses; // kalloc_zeroed() calls that cleared a page
+  uint lowmark;    // kswapd watermarks (free pages)
+  uint highmark;
+  uint tlbflushes; // TLB shootdowns that interrupted other CPUs
+  uint tlbipis;    // interrupts sent for them
+  uint scanned;    // LRU pages looked at by reclaim
+  uint activated;  // pages promoted to the active list
+  uint deactivated; // active pages aged onto the inactive list
+  uint refaults;   // faults on pages reclaim swapped out
+  uint wsrefaults; // of which were back soon enough to count as
+                   // working set, and went straight to the active list
+  uint swapcached; // resident pages whose swap slot is kept
+  uint cleanevicts; // of the evicted pages, clean ones dropped unwritten
+  uint zeroevicts;  // and all-zero ones, kept as PTE_ZERO without a slot
+  uint zeroins;     // PTE_ZERO pages faulted back in
+  uint writeback;   // evicted pages whose swap write is in flight
+  uint wbfaults;    // faults on such pages, served from memory
+  uint zswappages;   // pages used by the compressed swap pool
+  uint zswapstored;  // swapped-out pages held there
+  uint zswapbytes;   // their compressed size in bytes
+  uint zswapstores;  // pages put in the pool
+  uint zswaploads;   // swap-ins served from the pool
+  uint zswapmisses;  // swap-ins that had to read the disk
+  uint zswaprejects; // pages that didn't compress well enough
+  uint zswapwriteback; // pool pages moved on to disk to make room
+  uint zswapcompkc;  // time spent compressing, in 1024-cycle units
+  uint zswapdecompkc; // and decompressing
+  uint ksmscanned;   // pages hashed by ksmd
+  uint ksmmerged;    // frames freed by merging identical pages
+  uint ksmsweeps;    // passes ksmd made over all of memory
+  uint ksmkc;        // time ksmd spent, in 1024-cycle units
+};
@@ -0,0 +1,336 @@
+// Memory-mapped files and anonymous memory.
+//
+// Each process has NMMAP virtual memory areas (struct vma) above
+// MMAPBASE, between the heap and the kernel.  mmap() only records
+// the area; pages are read in from the file (or zero-filled) by
+// mmapfault() when first touched, unless MAP_POPULATE asks for
+// them up front.  A mapped buffer passed to a system call is
+// filled in by argptr() before the call takes any locks: filling
+// a page may sleep on the disk, or need the inode the call is
+// about to lock (a write() from a mapping of the same file).
+// Mapped pages go on the LRU like heap pages and file mappings
+// are private: writes never reach the file.
+//
+// MAP_SHARED anonymous areas are the exception.  Their frames
+// are allocated at mmap() time and fork() maps the same frames
+// writable into the child, counted in struct page's refcnt, so
+// related processes see each other's stores.  Since there is no
+// way to find every PTE of such a frame they are kept off the
+// LRU and never swapped.
+//
+// MAP_HUGE asks for private anonymous memory backed by 4 MB
+// pages (order HUGEORDER buddy blocks).  Such an area is 4 MB
+// aligned and faults fill in a whole large page at a time; when
+// no 4 MB block is free they fall back to 4 KB pages.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+
+static struct kmem_cache *vmacache;
+
+void
+mmapinit(void)
+{
+  vmacache = kmem_cache_create("vma", sizeof(struct vma));
+}
+
+// Return the area of p containing va, or 0.
+struct vma*
+mmapfind(struct proc *p, uint va)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NMMAP; i++){
+    v = p->vmas[i];
+    if(v && va >= v->start && va < v->end)
+      return v;
+  }
+  return 0;
+}
+
+// Is [va, va+n) inside a single mapped area of p?
+int
+mmapcheck(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  if((v = mmapfind(p, va)) == 0)
+    return 0;
+  return va + n >= va && va + n <= v->end;
+}
+
+// Find len bytes of unused address space above MMAPBASE,
+// starting at a multiple of align.
+static uint
+mmapspace(struct proc *p, uint len, uint align)
+{
+  struct vma *v;
+  uint a;
+  int i;
+
+  a = MMAPBASE;
+again:
+  a = (a + align - 1) & ~(align - 1);
+  if(a + len < a || a + len > KERNBASE)
+    return 0;
+  for(i = 0; i < NMMAP; i++){
+    v = p->vmas[i];
+    if(v && a < v->end && a + len > v->start){
+      a = v->end;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Fill in the page at va of area v.
+static int
+mmappage(struct proc *p, struct vma *v, uint va)
+{
+  char *mem;
+  uint perm;
+
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(v->f){
+    // Past the end of the file the page stays zero.
+    ilock(v->f->ip);
+    readi(v->f->ip, mem, v->off + (va - v->start), PGSIZE);
+    iunlock(v->f->ip);
+  }
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  if(!(v->flags & MAP_SHARED))
+    lru_insert(mem, p->pgdir, (char*)va);
+  return 0;
+}
+
+// Fill in the 4 MB page around va of MAP_HUGE area v.
+// Returns -1 if no 4 MB block is free or part of that range
+// already has 4 KB pages.
+static int
+mmaphuge(struct proc *p, struct vma *v, uint va)
+{
+  pde_t *pde;
+  char *mem;
+
+  va &= ~(HUGEPGSIZE - 1);
+  pde = &p->pgdir[PDX(va)];
+  if(*pde != 0 || (mem = hugealloc()) == 0)
+    return -1;
+  memset(mem, 0, HUGEPGSIZE);
+  *pde = V2P(mem) | PTE_P | PTE_U | PTE_PS;
+  if(v->prot & PROT_WRITE)
+    *pde |= PTE_W;
+  lru_insert(mem, p->pgdir, (char*)va);
+  return 0;
+}
+
+// Fill in the page at va of area v, with a large page if the
+// area asks for them and one is available.
+static int
+mmapfill(struct proc *p, struct vma *v, uint va)
+{
+  if((v->flags & MAP_HUGE) && mmaphuge(p, v, va) == 0)
+    return 0;
+  return mmappage(p, v, va);
+}
+
+// Map length bytes of f starting at offset into the current
+// process, or anonymous zeroed memory if f is 0.  addr is a
+// hint; 0 lets the kernel choose.  Returns the address of the
+// mapping, or 0 on failure.
+uint
+mmap(uint addr, int length, int prot, int flags, struct file *f, int offset)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint a, len, align;
+  int i, slot;
+
+  if(length <= 0 || offset < 0 || offset % PGSIZE != 0)
+    return 0;
+  if(prot & ~(PROT_READ|PROT_WRITE))
+    return 0;
+  if(f && (f->type != FD_INODE || !f->readable))
+    return 0;
+  if(flags & MAP_SHARED){
+    // Only anonymous shared memory, and it is never demand-paged.
+    if(f)
+      return 0;
+    flags |= MAP_POPULATE;
+  }
+  if((flags & MAP_HUGE) && (f || (flags & MAP_SHARED)))
+    return 0;
+
+  slot = -1;
+  for(i = 0; i < NMMAP; i++)
+    if(p->vmas[i] == 0){
+      slot = i;
+      break;
+    }
+  if(slot < 0)
+    return 0;
+
+  align = PGSIZE;
+  if(flags & MAP_HUGE)
+    align = HUGEPGSIZE;
+  len = (length + align - 1) & ~(align - 1);
+  a = 0;
+  if(addr && addr % align == 0 && addr >= MMAPBASE &&
+     addr + len > addr && addr + len <= KERNBASE){
+    a = addr;
+    for(i = 0; i < NMMAP; i++)
+      if((v = p->vmas[i]) && a < v->end && a + len > v->start)
+        a = 0;
+  }
+  if(a == 0 && (a = mmapspace(p, len, align)) == 0)
+    return 0;
+
+  if((v = kmem_cache_alloc(vmacache)) == 0)
+    return 0;
+  p->vmas[slot] = v;
+  v->start = a;
+  v->end = a + len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = offset;
+  v->f = f ? filedup(f) : 0;
+
+  if((flags & MAP_POPULATE) && mmappopulate(p, v->start, len) < 0){
+    munmap(v->start);
+    return 0;
+  }
+  return v->start;
+}
+
+// Fill in every page of [va, va+n) not yet touched.  The range
+// must lie inside one area of p.  Returns -1 if out of memory.
+int
+mmappopulate(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if((v = mmapfind(p, va)) == 0)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if(p->pgdir[PDX(a)] & PTE_PS){
+      a = PGROUNDDOWN(a | (HUGEPGSIZE - 1));
+      continue;
+    }
+    // Resident or swapped out: reading it back takes no locks.
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && *pte != 0)
+      continue;
+    if(mmapfill(p, v, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Remove the mapping that starts at addr from the current process.
+int
+munmap(uint addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NMMAP; i++)
+    if((v = p->vmas[i]) && v->start == addr)
+      break;
+  if(i == NMMAP)
+    return -1;
+  deallocuvm(p->pgdir, v->end, v->start);
+  lcr3(V2P(p->pgdir));
+  if(v->f)
+    fileclose(v->f);
+  p->vmas[i] = 0;
+  kmem_cache_free(vmacache, v);
+  return 0;
+}
+
+// Handle a fault on a not-present page of a mapped area.
+// Returns -1 if va is not mapped or the access is not allowed.
+int
+mmapfault(struct proc *p, uint va, uint err)
+{
+  struct vma *v;
+  pte_t *pte;
+
+  va = PGROUNDDOWN(va);
+  if((v = mmapfind(p, va)) == 0)
+    return -1;
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE))
+    return -1;
+  if(p->pgdir[PDX(va)] & PTE_PS)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && *pte != 0)
+    return -1;
+  return mmapfill(p, v, va);
+}
+
+// Give child np a copy of the current process's mappings.
+// The pages are shared the same way fork shares the heap;
+// large pages are split first so they can be shared 4 KB at
+// a time.
+int
+mmapdup(struct proc *np)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NMMAP; i++){
+    if((v = p->vmas[i]) == 0)
+      continue;
+    if((np->vmas[i] = kmem_cache_alloc(vmacache)) == 0)
+      return -1;
+    *np->vmas[i] = *v;
+    if(v->f)
+      filedup(v->f);
+    if(hugesplitrange(p->pgdir, v->start, v->end) < 0)
+      return -1;
+    if(copyuvmrange(p->pgdir, np->pgdir, v->start, v->end,
+                    v->flags & MAP_SHARED) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Drop all of p's mappings.  The pages themselves are freed
+// with the page table.
+void
+mmapclose(struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NMMAP; i++){
+    if((v = p->vmas[i]) == 0)
+      continue;
+    if(v->f)
+      fileclose(v->f);
+    p->vmas[i] = 0;
+    kmem_cache_free(vmacache, v);
+  }
+}
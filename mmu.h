@@ -83,7 +83,9 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define HUGEPGSIZE      (PGSIZE*NPTENTRIES) // bytes mapped by a PTE_PS PDE
 
+#define PGSHIFT         12      // log2(PGSIZE)
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
 
@@ -96,12 +98,22 @@ struct segdesc {
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
 #define PTE_A		0x20
+#define PTE_D		0x40	// Dirty
+#define PTE_COW		0x800	// Copy-on-write (software-defined)
+
+// A not-present PTE is 0 for a page never touched, or a swap slot
+// shifted left by one, or PTE_ZERO for a page that was all zeros
+// when it was swapped out and has no slot.
+#define PTE_ZERO	0x80000000
+
+// Page fault error code bits.
+#define FEC_PR          0x1     // Fault on a present page
+#define FEC_WR          0x2     // Fault caused by a write
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
 #ifndef __ASSEMBLER__
-typedef uint pte_t;
 
 // Task state segment format
 struct taskstate {
@@ -178,11 +190,35 @@ struct gatedesc {
   (gate).off_31_16 = (uint)(off) >> 16;                  \
 }
 
+// Per-frame descriptor; see pa2page().  pgdir/vaddr name the one
+// mapping the LRU lists track, and flags say which list the page
+// is on.  swapslot is the swap slot that still holds a copy of a
+// page read back in from swap (the swap cache), or 0.  refcnt
+// counts the page tables sharing the frame copy-on-write; 0 and
+// 1 both mean unshared.  refcnt and flags are protected by
+// lru_lock.  While the frame is free, next/prev link the buddy
+// free list instead of the LRU and order is the block's order
+// plus one (kmem.lock).
 struct page{
 	struct page *next;
 	struct page *prev;
 	pde_t *pgdir;
 	char *vaddr;
+	int refcnt;
+	int order;
+	int flags;
+	uint swapslot;
+	uint ksmsum;	// content hash when ksmd last looked
+};
+
+#define PG_ACTIVE     0x1   // on the active list
+#define PG_REFERENCED 0x2   // seen referenced once on the inactive list
+
+// A circular LRU list; head is the most recently added page and
+// head->prev the oldest.
+struct lrulist {
+	struct page *head;
+	int n;
 };
 
 
@@ -2,7 +2,7 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
+#define NMMAP        16  // mmap() areas per process
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
@@ -13,4 +13,10 @@
 #define FSSIZE       100000  // size of file system in blocks
 #define SWAPBASE	500
 #define SWAPMAX		(100000 - SWAPBASE)
+#define NSWAPSLOTS	(SWAPMAX / 8)  // 4096-byte pages that fit in swap
+#define MAXORDER     10  // largest buddy block is 2^MAXORDER pages
+#define HUGEORDER    10  // buddy order of a 4 MB large page
+#define SWAPRA_INIT	4   // initial swap readahead window (pages)
+#define SWAPRA_MAX	16  // largest swap readahead window
+#define ZSWAPPAGES	1024  // most pages the compressed swap pool can use
 
@@ -88,6 +88,8 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->ra_n = 0;
+  p->ra_window = SWAPRA_INIT;
 
   release(&ptable.lock);
 
@@ -153,6 +155,39 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Start a kernel thread running fn, which must never return.
+// It gets a kernel-only page table and no open files; it starts
+// out in forkret like any new process, but forkret "returns"
+// into fn instead of trapret.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread: allocproc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread: out of memory?");
+  p->sz = 0;
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
+// The page table of process slot i, or 0.  Read without
+// ptable.lock, for lru_adopt() in vm.c: wait() and fork() clear
+// p->pgdir before freeing the page table, and freevm() frees page
+// tables under lru_lock, so one found here with lru_lock held
+// stays valid until that lock is released.
+pde_t*
+procpgdir(int i)
+{
+  return ptable.proc[i].pgdir;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -163,8 +198,11 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Only reserve the range; pages are zero-filled on first
+    // touch by lazyfault().
+    if(sz + n < sz || sz + n > MMAPBASE)
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -183,6 +221,7 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  pde_t *pgdir;
   //cprintf("hi~ i'm fork\n");
   // Allocate process.
   if((np = allocproc()) == 0){
@@ -197,6 +236,16 @@ fork(void)
     return -1;
   }
   //cprintf("after copyuvm...\n");
+  if(mmapdup(np) < 0){
+    mmapclose(np);
+    pgdir = np->pgdir;
+    np->pgdir = 0;  // before freeing it: see procpgdir()
+    freevm(pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -235,7 +284,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Close all open files, including mapped ones.
+  mmapclose(curproc);
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
       fileclose(curproc->ofile[fd]);
@@ -276,6 +326,8 @@ wait(void)
   struct proc *p;
   int havekids, pid;
   struct proc *curproc = myproc();
+  pde_t *pgdir;
+  char *kstack;
   
   acquire(&ptable.lock);
   for(;;){
@@ -287,16 +339,22 @@ wait(void)
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
+        // Free the memory after releasing ptable.lock: freevm()
+        // takes lru_lock and swaplock, which are held around
+        // wakeup() and sleep() and so come before ptable.lock.
         pid = p->pid;
-        kfree(p->kstack);
+        kstack = p->kstack;
         p->kstack = 0;
-        freevm(p->pgdir);
+        pgdir = p->pgdir;
+        p->pgdir = 0;  // before freeing it: see procpgdir()
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
         release(&ptable.lock);
+        kfree(kstack);
+        freevm(pgdir);
         return pid;
       }
     }
@@ -325,6 +383,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -332,10 +391,12 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -346,6 +407,7 @@ scheduler(void)
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
+      c->pgdir = 0;
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -353,6 +415,9 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Idle: spend the time zeroing a page for kalloc_zeroed().
+    if(!ran)
+      kzero_idle();
   }
 }
 
@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // User page table in %cr3, or null
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +35,16 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A mapped area of a process's address space (see mmap.c).
+struct vma {
+  uint start;                  // First address, page-aligned
+  uint end;                    // One past the last address
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_* flags
+  uint off;                    // File offset of start
+  struct file *f;              // Mapped file, or 0 if anonymous
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -49,6 +60,10 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint ra_va;                  // First page of the last swap readahead
+  int ra_n;                    // Number of pages read ahead there
+  int ra_window;               // Current swap readahead window (pages)
+  struct vma *vmas[NMMAP];     // mmap() areas, or 0
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,106 @@
+// IPC bandwidth benchmark: a child sends TOTAL bytes to its
+// parent, first through a pipe and then through a MAP_SHARED
+// buffer.  In the shared-memory case the pipe only carries
+// one-byte "full"/"empty" tokens; the data itself is never
+// copied by the kernel.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define CHUNK   (16*4096)       // bytes per shared-memory round
+#define TOTAL   (4*1024*1024)
+
+char buf[4096];
+
+void
+report(char *name, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "%s: %d KB in %d ticks, %d KB/sec\n",
+         name, TOTAL/1024, ticks, TOTAL/1024 * 100 / ticks);
+}
+
+int
+pipebench(void)
+{
+  int fds[2], n, i, start, sum;
+
+  if(pipe(fds) < 0){
+    printf(1, "shmbench: pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(i = 0; i < sizeof(buf); i++)
+      buf[i] = i;
+    for(i = 0; i < TOTAL; i += sizeof(buf))
+      write(fds[1], buf, sizeof(buf));
+    exit();
+  }
+  close(fds[1]);
+  sum = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    sum += n;
+  close(fds[0]);
+  wait();
+  if(sum != TOTAL)
+    printf(1, "shmbench: pipe lost data (%d bytes)\n", sum);
+  return uptime() - start;
+}
+
+int
+shmbench(void)
+{
+  int full[2], empty[2], i, j, start;
+  uint *shm, sum;
+  char c;
+
+  shm = (uint*)mmap(0, CHUNK, PROT_READ|PROT_WRITE,
+                    MAP_ANONYMOUS|MAP_SHARED, -1, 0);
+  if(shm == 0){
+    printf(1, "shmbench: mmap failed\n");
+    exit();
+  }
+  if(pipe(full) < 0 || pipe(empty) < 0){
+    printf(1, "shmbench: pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  if(fork() == 0){
+    for(i = 0; i < TOTAL; i += CHUNK){
+      for(j = 0; j < CHUNK/4; j++)
+        shm[j] = i + j;
+      write(full[1], "f", 1);
+      read(empty[0], &c, 1);
+    }
+    exit();
+  }
+  for(i = 0; i < TOTAL; i += CHUNK){
+    read(full[0], &c, 1);
+    sum = 0;
+    for(j = 0; j < CHUNK/4; j++)
+      sum += shm[j] - (i + j);
+    if(sum != 0)
+      printf(1, "shmbench: bad data in round %d\n", i / CHUNK);
+    write(empty[1], "e", 1);
+  }
+  wait();
+  close(full[0]);
+  close(full[1]);
+  close(empty[0]);
+  close(empty[1]);
+  munmap((uint)shm);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  report("pipe         ", pipebench());
+  report("shared memory", shmbench());
+  exit();
+}
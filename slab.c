@@ -0,0 +1,232 @@
+// Object caches for small kernel structures.
+//
+// Each cache hands out objects of one size, packed into pages
+// ("slabs") taken from kalloc().  A slab's header sits at the
+// start of its page, so kmem_cache_free() finds it by rounding
+// the object's address down.  Slabs with free objects are kept
+// on the cache's partial list; full slabs are on no list.  An
+// empty slab goes back to kalloc() unless it is the cache's only
+// partial one.
+//
+// On top of that each CPU keeps a short list of free objects for
+// each cache, refilled and drained SLAB_BATCH at a time like the
+// page allocator's per-CPU caches, so most allocations and frees
+// take no lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NCACHE     8
+#define SLAB_BATCH 8
+#define SLAB_HIGH  (4*SLAB_BATCH)
+
+struct object {
+  struct object *next;
+};
+
+struct slab {
+  struct slab *next;      // partial list
+  struct slab *prev;
+  struct kmem_cache *cache;
+  struct object *free;    // free objects in this slab
+  int inuse;              // objects handed out, incl. per-CPU lists
+};
+
+struct kmem_cpu {
+  struct object *free;
+  int count;
+} __attribute__((aligned(64)));
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;              // object size, rounded up to a word
+  uint perslab;           // objects per slab
+  struct slab *partial;   // slabs with free objects
+  uint nslabs;
+  struct kmem_cpu cpu[NCPU];
+};
+
+static struct kmem_cache caches[NCACHE];
+static int ncaches;
+
+// Make a cache of objects of size bytes.  Only called during
+// boot, before the other CPUs start; the cache's pages are
+// allocated when its first object is.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  if(size < sizeof(struct object) || size > PGSIZE - sizeof(struct slab))
+    panic("kmem_cache_create: size");
+  if(ncaches == NCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &caches[ncaches++];
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+static void
+slab_unlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+slab_link(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Carve the page mem into a new slab for c.
+// Caller must hold c->lock.
+static void
+slab_init(struct kmem_cache *c, char *mem)
+{
+  struct slab *s;
+  struct object *o;
+  uint i;
+
+  s = (struct slab*)mem;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(i = c->perslab; i > 0; i--){
+    o = (struct object*)(mem + sizeof(struct slab) + (i-1) * c->size);
+    o->next = s->free;
+    s->free = o;
+  }
+  slab_link(c, s);
+  c->nslabs++;
+}
+
+// Give object o back to its slab.  Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, struct object *o)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)o);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  if(s->free == 0)
+    slab_link(c, s);
+  o->next = s->free;
+  s->free = o;
+  if(--s->inuse == 0 && (c->partial != s || s->next)){
+    slab_unlink(c, s);
+    c->nslabs--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct kmem_cpu *cc;
+  struct object *o;
+  struct slab *s;
+  char *mem;
+  int n;
+
+  pushcli();
+  cc = &c->cpu[cpuid()];
+  if((o = cc->free) != 0){
+    cc->free = o->next;
+    cc->count--;
+  }
+  popcli();
+  if(o)
+    return o;
+
+  // kalloc() may reclaim, so don't hold the lock across it.
+  acquire(&c->lock);
+  if(c->partial == 0){
+    release(&c->lock);
+    if((mem = kalloc()) == 0)
+      return 0;
+    acquire(&c->lock);
+    slab_init(c, mem);
+  }
+
+  // One object for the caller, and up to a batch more for
+  // this CPU's list.
+  cc = &c->cpu[cpuid()];
+  mem = 0;
+  for(n = 0; n <= SLAB_BATCH && (s = c->partial) != 0; n++){
+    o = s->free;
+    s->free = o->next;
+    s->inuse++;
+    if(s->free == 0)
+      slab_unlink(c, s);
+    if(mem == 0){
+      mem = (char*)o;
+      continue;
+    }
+    o->next = cc->free;
+    cc->free = o;
+    cc->count++;
+  }
+  release(&c->lock);
+  return mem;
+}
+
+// Return object v to cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *v)
+{
+  struct kmem_cpu *cc;
+  struct object *o;
+  int n;
+
+  o = (struct object*)v;
+  pushcli();
+  cc = &c->cpu[cpuid()];
+  o->next = cc->free;
+  cc->free = o;
+  if(++cc->count > SLAB_HIGH){
+    acquire(&c->lock);
+    for(n = 0; n < SLAB_BATCH; n++){
+      o = cc->free;
+      cc->free = o->next;
+      cc->count--;
+      slab_put(c, o);
+    }
+    release(&c->lock);
+  }
+  popcli();
+}
+
+// Pages held by all the object caches.
+int
+slabpages(void)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < ncaches; i++)
+    n += caches[i].nslabs;
+  return n;
+}
@@ -1,4 +1,3 @@
-
 #include "param.h"
 #include "types.h"
 #include "stat.h"
@@ -8,39 +7,148 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "memstat.h"
+#include "memctl.h"
 
+#define PGSIZE 4096
+#define SECTS_PER_PG (PGSIZE/BSIZE)
 
-int main () {
-	int a, b;
-	//ls();
-	//int mem;
-	printf(1,"hi~~\n");
-	//mem =freemem();
-	//printf(1, "mem : %d\n", mem);
-	//sbrk(0);
-	
-	malloc(5990000);
-		
-//	int f;
-	/*
-	for (int i = 0; i < 20; i++) {
-	if ((f = fork()) == 0) {
-		mem = freemem();
-		printf(1, "1 mem : %d\n", mem);
+// Print how many pages moved through swap in a phase and
+// the resulting throughput.
+void
+report(char *phase, int sectors, int ticks) {
+	int pages = sectors / SECTS_PER_PG;
+
+	if (ticks == 0)
+		ticks = 1;
+	printf(1, "%s: %d pages in %d ticks, %d pages/sec\n",
+		phase, pages, ticks, pages * 100 / ticks);
+}
+
+// Allocates and touches a large heap, then reads it back, so that
+// under memory pressure the first pass measures swap-out and the
+// second swap-in throughput.
+void
+run(int sz) {
+	int a, b, i, t0, t1, t2, sum, want, csum, pid;
+	struct memstat st0, st1, st2, st3;
+	char *p;
+
+	memstat(&st0);
+	t0 = uptime();
+	p = malloc(sz);
+	if (p == 0) {
+		printf(1, "malloc failed\n");
 		exit();
-		} else {
-			mem = freemem();
-			printf(1, "2 mem : %d\n", mem);
-			wait();
-			}
-	}*/
+	}
+	// A non-zero byte per page, different from its neighbours',
+	// so that a page swapped in from the wrong slot, or lost and
+	// refilled with zeros, changes the checksum.
+	want = 0;
+	for (i = 0; i < sz; i += PGSIZE) {
+		p[i] = (i / PGSIZE) % 251 + 1;
+		want += p[i];
+	}
+	t1 = uptime();
+	memstat(&st1);
 
+	sum = 0;
+	for (i = 0; i < sz; i += PGSIZE)
+		sum += p[i];
+	t2 = uptime();
+	memstat(&st2);
+	if (sum != want)
+		printf(1, "checksum mismatch: %d, expected %d\n", sum, want);
+
+	report("swap out", st1.swapwrite - st0.swapwrite, t1 - t0);
+	report("swap in ", st2.swapread - st1.swapread, t2 - t1);
+	printf(1, "reclaim: %d pages scanned for %d evicted, %d refaults\n",
+		st2.scanned - st0.scanned, st2.evicted - st0.evicted,
+		st2.refaults - st0.refaults);
+	printf(1, "zero pages: %d evicted without a slot, %d faulted back\n",
+		st2.zeroevicts - st0.zeroevicts, st2.zeroins - st0.zeroins);
+	printf(1, "writeback: %d faults served from pages still being written\n",
+		st2.wbfaults - st0.wbfaults);
+
+	// Forking shares the swapped-out pages with the child, so
+	// fork itself should not touch the swap area.
+	memstat(&st2);
+	pid = fork();
+	if (pid == 0) {
+		csum = 0;
+		for (i = 0; i < sz; i += PGSIZE)
+			csum += p[i];
+		if (csum != sum)
+			printf(1, "child checksum mismatch: %d\n", csum);
+		exit();
+	}
+	memstat(&st3);
+	printf(1, "fork: %d sectors read, %d written\n",
+		st3.swapread - st2.swapread, st3.swapwrite - st2.swapwrite);
+	if (pid > 0)
+		wait();
+
+	// Everything was only read since the last swap-in, so pages
+	// evicted from here on should still be clean in the swap cache.
+	memstat(&st3);
+	printf(1, "swap cache: %d pages, %d evicted clean since fork\n",
+		st3.swapcached, st3.cleanevicts - st2.cleanevicts);
+
+	if (st3.zswapstores != st0.zswapstores) {
+		a = st3.zswapstores - st0.zswapstores;
+		b = st3.zswaploads - st0.zswaploads;
+		printf(1, "zswap: %d pages in %d pool pages, %d bytes each on average\n",
+			st3.zswapstored, st3.zswappages,
+			st3.zswapstored ? st3.zswapbytes / st3.zswapstored : 0);
+		printf(1, "zswap: %d hits, %d misses, %d written back\n",
+			b, st3.zswapmisses - st0.zswapmisses,
+			st3.zswapwriteback - st0.zswapwriteback);
+		printf(1, "zswap: %d cycles per store, %d per load\n",
+			(st3.zswapcompkc - st0.zswapcompkc) * 1024 / a,
+			b ? (st3.zswapdecompkc - st0.zswapdecompkc) * 1024 / b : 0);
+	}
 
     swapstat(&a, &b);
     printf(1, "swap read : %d, swap write : %d\n", a, b);
     int mem = freemem();
     printf(1, "memory : %d\n", mem);
-    exit();
-    return 0;
+    printf(1, "checksum : %d\n", sum);
 }
 
+// usage: swaptest [-z | -c] [bytes]
+// -z swaps through the compressed pool; -c runs the test once
+// against the disk only and once with the pool, to compare them.
+int main (int argc, char *argv[]) {
+	int sz, zpages, mode, i;
+
+	printf(1,"hi~~\n");
+	sz = 5990000;
+	mode = 0;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-z") == 0)
+			mode = 'z';
+		else if (strcmp(argv[i], "-c") == 0)
+			mode = 'c';
+		else
+			sz = atoi(argv[i]);
+	}
+
+	zpages = memctl(MC_ZSWAP, -1);
+	if (mode == 'c') {
+		for (i = 0; i < 2; i++) {
+			printf(1, "--- %s ---\n", i ? "compressed pool" : "disk only");
+			memctl(MC_ZSWAP, i ? ZSWAPPAGES : 0);
+			if (fork() == 0) {
+				run(sz);
+				exit();
+			}
+			wait();
+		}
+	} else {
+		if (mode == 'z')
+			memctl(MC_ZSWAP, ZSWAPPAGES);
+		run(sz);
+	}
+	memctl(MC_ZSWAP, zpages);
+	exit();
+}
@@ -19,7 +19,8 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if((addr >= curproc->sz || addr+4 > curproc->sz) &&
+     !mmapcheck(curproc, addr, 4))
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -33,11 +34,15 @@ fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
   struct proc *curproc = myproc();
+  struct vma *v;
 
-  if(addr >= curproc->sz)
+  if(addr < curproc->sz)
+    ep = (char*)curproc->sz;
+  else if((v = mmapfind(curproc, addr)) != 0)
+    ep = (char*)v->end;
+  else
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -63,7 +68,14 @@ argptr(int n, char **pp, int size)
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+     !mmapcheck(curproc, i, size))
+    return -1;
+  // Fault the buffer in now, before the call takes locks that
+  // a fault could not sleep under (see uvmprefault).
+  if(uvmprefault(curproc, i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -107,6 +119,10 @@ extern int sys_swapread(void);
 extern int sys_swapwrite(void);
 extern int sys_swapstat(void);
 extern int sys_freemem(void);
+extern int sys_memctl(void);
+extern int sys_memstat(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +150,10 @@ static int (*syscalls[])(void) = {
 [SYS_swapwrite] sys_swapwrite,
 [SYS_swapstat] sys_swapstat,
 [SYS_freemem] sys_freemem,
+[SYS_memctl]  sys_memctl,
+[SYS_memstat] sys_memstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
 };
 
 void
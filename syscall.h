@@ -24,3 +24,7 @@
 #define SYS_swapwrite	23
 #define SYS_swapstat	24
 #define SYS_freemem	25
+#define SYS_memctl	26
+#define SYS_memstat	27
+#define SYS_mmap	28
+#define SYS_munmap	29
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "memstat.h"
 extern int print_len();
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -443,27 +444,39 @@ sys_pipe(void)
   return 0;
 }
 
+// The disk transfers swap pages by interrupt, possibly on another
+// CPU, so user buffers are bounced through a kernel page.
 int sys_swapread(void)
 {
 	char* ptr;
+	char* mem;
 	int blkno;
 
 	if(argptr(0, &ptr, PGSIZE) < 0 || argint(1, &blkno) < 0 )
 		return -1;
+	if((mem = kalloc()) == 0)
+		return -1;
 
-	swapread(ptr, blkno);
+	swapread(mem, blkno);
+	memmove(ptr, mem, PGSIZE);
+	kfree(mem);
 	return 0;
 }
 
 int sys_swapwrite(void)
 {
 	char* ptr;
+	char* mem;
 	int blkno;
 
 	if(argptr(0, &ptr, PGSIZE) < 0 || argint(1, &blkno) < 0 )
 		return -1;
+	if((mem = kalloc()) == 0)
+		return -1;
 
-	swapwrite(ptr, blkno);
+	memmove(mem, ptr, PGSIZE);
+	swapwrite(mem, blkno);
+	kfree(mem);
 	return 0;
 }
 
@@ -482,3 +495,42 @@ int sys_swapstat(void)
 	//*nr_write = print_len();
 	return 0;
 }
+
+int sys_memstat(void)
+{
+	struct memstat *st;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+
+	getmemstat(st);
+	st->swapread = nr_sectors_read;
+	st->swapwrite = nr_sectors_write;
+	return 0;
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int addr, length, prot, flags, offset;
+
+  if(argint(0, &addr) < 0 || argint(1, &length) < 0 ||
+     argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argint(5, &offset) < 0)
+    return 0;
+  f = 0;
+  if(!(flags & MAP_ANONYMOUS) && argfd(4, 0, &f) < 0)
+    return 0;
+  return mmap(addr, length, prot, flags, f, offset);
+}
+
+int
+sys_munmap(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return munmap(addr);
+}
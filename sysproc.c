@@ -95,3 +95,13 @@ sys_freemem(void)
 {
 	return freemem();
 	}
+
+int
+sys_memctl(void)
+{
+	int cmd, val;
+
+	if (argint(0, &cmd) < 0 || argint(1, &val) < 0)
+		return -1;
+	return memctl(cmd, val);
+}
@@ -0,0 +1,142 @@
+// TLB shootdown.
+//
+// A CPU that changes a PTE only drops its own TLB entry; other
+// CPUs running the same page table have to be told with an
+// inter-processor interrupt.  Callers collect the addresses they
+// changed in a struct tlbbatch and hand the whole batch to
+// tlbflush(), which interrupts only the CPUs whose %cr3 holds
+// one of the batch's page tables, once each, and waits until
+// all of them have run invlpg for their entries.
+//
+// One shootdown runs at a time.  A CPU waiting to start its own
+// polls for requests aimed at it, so two CPUs shooting at each
+// other don't deadlock.  tlbflush() must not be called with a
+// spinlock held: a target spinning for that lock with interrupts
+// off would never answer.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "traps.h"
+#include "tlb.h"
+
+static struct {
+  volatile uint busy;       // a shootdown is in progress
+  volatile uint wait;       // CPUs yet to answer, one bit each
+  struct tlbbatch b;
+} shoot;
+
+uint nr_tlbflushes;  // shootdowns that interrupted other CPUs
+uint nr_tlbipis;     // interrupts sent for them
+
+void
+tlbinit(struct tlbbatch *b)
+{
+  b->n = 0;
+  b->full = 0;
+}
+
+// Note that va in pgdir has changed.
+void
+tlbadd(struct tlbbatch *b, pde_t *pgdir, uint va)
+{
+  if(b->n == TLB_BATCH){
+    b->full = 1;
+    return;
+  }
+  b->pgdir[b->n] = pgdir;
+  b->va[b->n] = va;
+  b->n++;
+}
+
+// Apply batch b to this CPU's TLB.
+static void
+tlblocal(struct tlbbatch *b)
+{
+  pde_t *pgdir;
+  int i;
+
+  if((pgdir = mycpu()->pgdir) == 0)
+    return;
+  if(b->full){
+    lcr3(rcr3());
+    return;
+  }
+  for(i = 0; i < b->n; i++)
+    if(b->pgdir[i] == pgdir)
+      invlpg(b->va[i]);
+}
+
+// Answer the shootdown in progress.
+// Called from trap() with interrupts off.
+void
+tlbintr(void)
+{
+  uint me;
+
+  me = 1 << cpuid();
+  if(shoot.wait & me){
+    tlblocal(&shoot.b);
+    __sync_fetch_and_and(&shoot.wait, ~me);
+  }
+}
+
+// Does c have one of the page tables in b loaded?
+static int
+tlbtarget(struct cpu *c, struct tlbbatch *b)
+{
+  int i;
+
+  if(c->pgdir == 0)
+    return 0;
+  if(b->full)
+    return 1;
+  for(i = 0; i < b->n; i++)
+    if(b->pgdir[i] == c->pgdir)
+      return 1;
+  return 0;
+}
+
+// Invalidate every entry of b on all CPUs, and empty b.
+void
+tlbflush(struct tlbbatch *b)
+{
+  struct cpu *c;
+  uint mask;
+
+  if(b->n == 0 && !b->full)
+    return;
+
+  pushcli();
+  while(xchg(&shoot.busy, 1) != 0)
+    tlbintr();
+  shoot.b = *b;
+
+  // The PTE stores must be visible before we look at which page
+  // tables the other CPUs have loaded: a CPU switching to one of
+  // them after this point reloads %cr3 and can't see stale entries.
+  __sync_synchronize();
+  mask = 0;
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != mycpu() && tlbtarget(c, b))
+      mask |= 1 << (c - cpus);
+  shoot.wait = mask;
+  if(mask){
+    nr_tlbflushes++;
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(mask & (1 << (c - cpus))){
+        lapicipi(c->apicid, T_TLBFLUSH);
+        nr_tlbipis++;
+      }
+  }
+  tlblocal(b);
+  while(shoot.wait)
+    ;
+
+  xchg(&shoot.busy, 0);
+  popcli();
+  tlbinit(b);
+}
@@ -0,0 +1,11 @@
+// A batch of TLB invalidations for tlbflush(): each entry is a
+// virtual address in some page table.  Past TLB_BATCH entries
+// the batch just asks for whole TLBs to be flushed.
+#define TLB_BATCH 32
+
+struct tlbbatch {
+  int n;
+  int full;                   // overflowed: flush everything
+  pde_t *pgdir[TLB_BATCH];
+  uint va[TLB_BATCH];
+};
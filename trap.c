@@ -13,7 +13,6 @@ struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
-extern void swapin();
 void
 tvinit(void)
 {
@@ -71,6 +70,10 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -79,8 +82,9 @@ trap(struct trapframe *tf)
     break;
    case T_PGFLT:
    	//cprintf("page fault!!\n");
-	swapin(myproc(), rcr2());
-	break;
+	if (myproc() && pgfault(myproc(), rcr2(), tf->err) == 0)
+		break;
+	// Not a page we can fix up: a real fault.
 
   //PAGEBREAK: 13
   default:
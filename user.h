@@ -1,4 +1,5 @@
 struct stat;
+struct memstat;
 struct rtcdate;
 
 // system calls
@@ -27,6 +28,10 @@ void swapread(const char*, int);
 void swapwrite(const char*, int);
 void swapstat(int*, int*);
 int freemem(void);
+int memctl(int, int);
+int memstat(struct memstat*);
+uint mmap(uint, int, int, int, int, int);
+int munmap(uint);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "memstat.h"
 
 char buf[8192];
 char name[3];
@@ -1411,6 +1412,181 @@ forktest(void)
   printf(1, "fork test OK\n");
 }
 
+// parent and child write to the same copy-on-write pages,
+// and through read() so the kernel takes the write fault.
+void
+cowtest(void)
+{
+  static char buf[3*4096];
+  int fds[2], i, pid;
+
+  printf(1, "cow test\n");
+
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'p';
+  if(pipe(fds) != 0){
+    printf(1, "cow pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "cow fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < 4096; i++)
+      buf[i] = 'c';
+    if(read(fds[0], buf + 4096, 10) != 10){
+      printf(1, "cow read failed\n");
+      exit();
+    }
+    for(i = 0; i < sizeof(buf); i++){
+      if(buf[i] != (i < 4096 ? 'c' : i < 4096 + 10 ? 'x' : 'p')){
+        printf(1, "cow child saw wrong data\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  if(write(fds[1], "xxxxxxxxxx", 10) != 10){
+    printf(1, "cow write failed\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < sizeof(buf); i++){
+    if(buf[i] != 'p'){
+      printf(1, "cow parent saw child's writes\n");
+      exit();
+    }
+  }
+  printf(1, "cow test OK\n");
+}
+
+// sbrk() only reserves address space; pages appear as they
+// are touched, and read as zero.
+void
+lazysbrktest(void)
+{
+  char *a, *p;
+  int i, free0, free1;
+
+  printf(stdout, "lazy sbrk test\n");
+  free0 = freemem();
+  a = sbrk(1024*4096);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "lazy sbrk failed\n");
+    exit();
+  }
+  free1 = freemem();
+  if(free0 - free1 > 16){
+    printf(stdout, "lazy sbrk allocated %d pages up front\n", free0 - free1);
+    exit();
+  }
+  for(i = 0; i < 1024; i += 64){
+    p = a + i*4096;
+    if(*p != 0){
+      printf(stdout, "lazy sbrk page not zeroed\n");
+      exit();
+    }
+    *p = 1;
+  }
+  if(free0 - freemem() > 64){
+    printf(stdout, "lazy sbrk allocated untouched pages\n");
+    exit();
+  }
+  sbrk(-1024*4096);
+  printf(stdout, "lazy sbrk test OK\n");
+}
+
+// a file mapping reads the same bytes as read(), is filled in
+// lazily, and is inherited by a forked child.
+void
+mmaptest(void)
+{
+  static char buf[2*4096];
+  char *p;
+  int fd, i, n, free0, pid;
+
+  printf(stdout, "mmap test\n");
+  fd = open("README", O_RDONLY);
+  if(fd < 0){
+    printf(stdout, "mmap: open README failed\n");
+    exit();
+  }
+  n = read(fd, buf, sizeof(buf));
+  free0 = freemem();
+  p = (char*)mmap(0, sizeof(buf), PROT_READ, 0, fd, 0);
+  if(p == 0){
+    printf(stdout, "mmap failed\n");
+    exit();
+  }
+  if(freemem() < free0 - 1){
+    printf(stdout, "mmap read the file up front\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(p[i] != buf[i]){
+      printf(stdout, "mmap data differs at %d\n", i);
+      exit();
+    }
+  }
+  pid = fork();
+  if(pid == 0){
+    if(p[n-1] != buf[n-1])
+      printf(stdout, "mmap data differs in child\n");
+    exit();
+  }
+  wait();
+  if(munmap((uint)p) < 0 || munmap((uint)p) != -1){
+    printf(stdout, "munmap failed\n");
+    exit();
+  }
+  close(fd);
+  printf(stdout, "mmap test OK\n");
+}
+
+// MAP_HUGE memory is backed by 4 MB pages while there are free
+// 4 MB blocks, and survives fork (which splits it).
+void
+hugetest(void)
+{
+  struct memstat st0, st1;
+  int *p, i, pid;
+
+  printf(stdout, "huge page test\n");
+  memstat(&st0);
+  p = (int*)mmap(0, 8*1024*1024, PROT_READ|PROT_WRITE,
+                 MAP_ANONYMOUS|MAP_HUGE, -1, 0);
+  if(p == 0 || (uint)p % (4*1024*1024) != 0){
+    printf(stdout, "huge mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < 2*1024*1024; i += 1024)
+    p[i] = i;
+  memstat(&st1);
+  if(st0.hugefree >= 2 && st1.hugeused < st0.hugeused + 2){
+    printf(stdout, "huge mmap did not use large pages\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    for(i = 0; i < 2*1024*1024; i += 1024)
+      if(p[i] != i){
+        printf(stdout, "huge page data differs in child\n");
+        break;
+      }
+    exit();
+  }
+  wait();
+  if(munmap((uint)p) < 0){
+    printf(stdout, "huge munmap failed\n");
+    exit();
+  }
+  printf(stdout, "huge page test OK\n");
+}
+
 void
 sbrktest(void)
 {
@@ -1768,6 +1944,9 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  lazysbrktest();
+  mmaptest();
+  hugetest();
   validatetest();
 
   opentest();
@@ -1793,6 +1972,7 @@ main(int argc, char *argv[])
   dirfile();
   iref();
   forktest();
+  cowtest();
   bigdir(); // slow
 
   uio();
@@ -6,15 +6,20 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
-//#include "spinlock.h"
+#include "fcntl.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "tlb.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
-extern struct page* page_lru_head;
+extern struct lrulist lru_active, lru_inactive;
 extern int num_lru_pages;
 extern struct spinlock lru_lock;
-extern char* bitmap;
+extern int num_swap_pages;
 
 // set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -37,21 +42,27 @@ seginit(void)
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
+// create any required page table pages.  There is no PTE
+// under a 4 MB (PTE_PS) mapping; callers that care check
+// the PDE themselves.
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS){
+    if(alloc)
+      panic("walkpgdir: large page");
+    return 0;
+  }
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // kalloc_zeroed() makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -63,7 +74,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -121,25 +132,54 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
-pde_t*
-setupkvm(void)
+// Map size bytes at va to pa in the kernel's page table, with
+// 4 MB pages wherever va, pa and the remaining size allow.
+static void
+kmappages(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  for(; size > 0; va += n, pa += n, size -= n){
+    if(va % HUGEPGSIZE == 0 && pa % HUGEPGSIZE == 0 && size >= HUGEPGSIZE){
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      n = HUGEPGSIZE;
+    } else {
+      if(mappages(pgdir, (void*)va, PGSIZE, pa, perm) < 0)
+        panic("kmappages");
+      n = PGSIZE;
+    }
+  }
+}
+
+// Build kpgdir, the one set of kernel page tables.  The kernel
+// mappings never change after boot, so every process's page
+// directory points at these same page-table pages.  Most of
+// the direct map uses 4 MB pages (entry.S turned on CR4_PSE).
+static void
+buildkvm(void)
 {
-  pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
-    return 0;
-  memset(pgdir, 0, PGSIZE);
+  if((kpgdir = (pde_t*)kalloc_zeroed()) == 0)
+    panic("buildkvm");
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+    kmappages(kpgdir, (uint)k->virt, k->phys_end - k->phys_start,
+              (uint)k->phys_start, k->perm);
+}
 
+// Set up kernel part of a page table: a single page whose
+// upper entries are copied from kpgdir.
+pde_t*
+setupkvm(void)
+{
+  pde_t *pgdir;
+
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
+    return 0;
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
@@ -148,7 +188,7 @@ setupkvm(void)
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  buildkvm();
   switchkvm();
 }
 
@@ -181,6 +221,7 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  mycpu()->pgdir = p->pgdir;
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
@@ -193,8 +234,7 @@ inituvm(pde_t *pgdir, char *init, uint sz) //검토 완
   char *mem;
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U); //user page임
   memmove(mem, init, sz);
   lru_insert(mem, pgdir, 0);
@@ -239,13 +279,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz) //검토 완
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){ //a라는 주소로 pgdir에 매핑, user page로 할당
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -258,6 +297,45 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz) //검토 완
   return newsz;
 }
 
+// The LRU tracks a shared frame through one of its mappings.
+// When that mapping goes away and others remain, link the frame
+// under one of them, so it can still be aged and, once down to a
+// single mapping, swapped out.  fork() maps its copies at the
+// same address, so look there first; a frame merged by ksmd may
+// be anywhere.  Caller must hold lru_lock, which keeps the page
+// tables found through procpgdir() from being freed.
+static void
+lru_adopt(struct page *pg, uint pa, uint va)
+{
+  pde_t *pgdir;
+  pte_t *pte, *pt;
+  uint i, j, k;
+
+  for(i = 0; i < NPROC; i++){
+    if((pgdir = procpgdir(i)) == 0 || (pgdir[PDX(va)] & PTE_PS))
+      continue;
+    pte = walkpgdir(pgdir, (char*)va, 0);
+    if(pte && (*pte & PTE_P) && PTE_ADDR(*pte) == pa){
+      lru_link(pg, pgdir, (char*)va);
+      return;
+    }
+  }
+  for(i = 0; i < NPROC; i++){
+    if((pgdir = procpgdir(i)) == 0)
+      continue;
+    for(j = 0; j < PDX(KERNBASE); j++){
+      if((pgdir[j] & (PTE_P|PTE_PS)) != PTE_P)
+        continue;
+      pt = (pte_t*)P2V(PTE_ADDR(pgdir[j]));
+      for(k = 0; k < NPTENTRIES; k++)
+        if((pt[k] & PTE_P) && PTE_ADDR(pt[k]) == pa){
+          lru_link(pg, pgdir, (char*)PGADDR(j, k, 0));
+          return;
+        }
+    }
+  }
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -266,32 +344,70 @@ int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz) //검토 완
 {
   pte_t *pte;
+  struct page *pg;
   uint a, pa;
+  int owner;
 //cprintf("start deallocuvm...\n");
   if(newsz >= oldsz)
     return oldsz;
 
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
+    if(pgdir[PDX(a)] & PTE_PS){
+      // A MAP_HUGE page; munmap() always covers all of it.
+      // Re-check under lru_lock in case swapout() split it.
+      acquire(&lru_lock);
+      if(pgdir[PDX(a)] & PTE_PS){
+        pa = PTE_ADDR(pgdir[PDX(a)]);
+        lru_unlink(pa2page(pa));
+        pgdir[PDX(a)] = 0;
+        release(&lru_lock);
+        hugefree(P2V(pa));
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      release(&lru_lock);
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
 
     if(!pte) {//pte가 없으면..
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
 
     } else if((*pte & PTE_P) != 0) { //pte_p가 1이라는 이야기..일반적인 케이스
+      // swapout() may be evicting this page from another CPU;
+      // re-check the PTE under lru_lock before taking it.
+      acquire(&lru_lock);
+      if((*pte & PTE_P) == 0){
+        release(&lru_lock);
+        a -= PGSIZE;  // now swapped out; go around again
+        continue;
+      }
       pa = PTE_ADDR(*pte); //물리 주소 구하기
       if(pa == 0) 
         panic("kfree");
-      char *v = P2V(pa); //가상 주소로 변환
-      kfree(v);
+      pg = pa2page(pa);
       *pte = 0; //엔트리 0으로 초기화, pte가 있을 경우
-      lru_delete(v, pgdir, (char*)a);
+      owner = pg->pgdir == pgdir && pg->vaddr == (char*)a;
+      if(owner)
+        lru_unlink(pg);
+      if(pg->refcnt > 1){
+        // Still mapped copy-on-write by another process.
+        pg->refcnt--;
+        if(owner)
+          lru_adopt(pg, pa, a);
+        release(&lru_lock);
+        continue;
+      }
+      pg->refcnt = 0;
+      release(&lru_lock);
+      kfree(P2V(pa));
    } else {
 	int offset = *pte >> 1;
 	if (check_bitmap(offset)) {
 		set_bitmap(offset, 0);
 		*pte = 0;	
-	}		   
+	} else if (*pte == PTE_ZERO)
+		*pte = 0;
    } 
  }
   return newsz; 
@@ -307,13 +423,17 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  // The kernel's page tables are shared; free only the user ones.
+  // lru_adopt() walks page tables under lru_lock.
+  acquire(&lru_lock);
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
   }
   kfree((char*)pgdir);
+  release(&lru_lock);
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -329,71 +449,235 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz) //검토 완
+// Copy the user pages in [start, end) from pgdir to d.
+// Resident pages are shared copy-on-write: both page tables map
+// the frame read-only with PTE_COW set, and the first write to it
+// makes a private copy (see cowfault).  If share is set the pages
+// are MAP_SHARED memory and stay writable in both.  pgdir must be
+// the current page table.  Returns 0 on success, -1 if out of
+// memory.
+int
+copyuvmrange(pde_t *pgdir, pde_t *d, uint start, uint end, int share)
 {
-	
-  pde_t *d;
   pte_t *pte;
-  //pte_t *temp_pte;
+  struct page *pg;
   uint pa, i, flags;
-  char *mem;
-  if((d = setupkvm()) == 0) //child의 pgdir값 생성
-    return 0;
+  struct tlbbatch b;
 
-  for(i = 0; i < sz; i += PGSIZE) {
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  tlbinit(&b);
+  for(i = start; i < end; i += PGSIZE) {
+    // Holes left by lazy sbrk have nothing to copy.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || *pte == 0)
+      continue;
+
+    // Share the frame.  Take the reference under lru_lock so
+    // swapout() can't evict the page from under us.
+    acquire(&lru_lock);
+    if(*pte & PTE_P){
+      if(!share && (*pte & PTE_W)){
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+        tlbadd(&b, pgdir, i);
+      }
+      pa = PTE_ADDR(*pte);
+      flags = PTE_FLAGS(*pte);
+      pg = pa2page(pa);
+      pg->refcnt = (pg->refcnt ? pg->refcnt : 1) + 1;
+      release(&lru_lock);
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0){
+        acquire(&lru_lock);
+        pg->refcnt--;
+        release(&lru_lock);
+        goto bad;
+      }
+      continue;
+    }
+    release(&lru_lock);
 
     if(!(*pte & PTE_P)) { //원래는 panic... 근데 PTE_P가 0이더라도 SWAP 된 경우 처리 필요
 	int offset = (*pte) >> 1;
 	if (check_bitmap(offset)) {
-		mem = kalloc();
-		swapread(mem, offset);
-		
-		int blkno = find_bitmap();
-		if (blkno == -1) {
-			cprintf("OOM ERROR\n");
+		// Point the child at the same slot; each process reads
+		// its own copy when it faults the page back in.
+		pte_t *temp = walkpgdir(d, (void*)i, 1);
+		if (temp == 0)
 			goto bad;
-		}
-		swapwrite(mem, blkno);
-		set_bitmap(blkno, 1);
-
-		if (mappages(d, (void*)i, PGSIZE, V2P(mem), 0) < 0) {
-			kfree(mem);
+		swap_dup(offset);
+		*temp = offset << 1;
+	} else if (*pte == PTE_ZERO) {
+		pte_t *temp = walkpgdir(d, (void*)i, 1);
+		if (temp == 0)
 			goto bad;
-		}
-		pte_t *temp = walkpgdir(d, (void*)i, 0);
-		*temp = blkno << 1;
-		kfree(mem);
-				
+		*temp = PTE_ZERO;
 	} else {
 		panic("copyuvm: pte not present");
 	}
-    } else {
-	
-	pa = PTE_ADDR(*pte);
-	flags = PTE_FLAGS(*pte);
-	if ((mem = kalloc()) == 0)
-		goto bad;
-
-	memmove(mem, (char*)P2V(pa), PGSIZE); //페이지 값 옮기기
-
-      //panic("copyuvm: page not present");
-    	if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      		kfree(mem);
-      		goto bad;
-    	} //매핑 완료
-	lru_insert(mem, d, (char*)i);
     }
   }		
-  return d;
+  // Drop stale writable TLB entries for the parent's pages.
+  // A large copy overflows the batch into a full flush.
+  tlbflush(&b);
+  return 0;
 
 bad:
-  freevm(d);
-  return 0; 
+  tlbflush(&b);
+  return -1;
+}
+
+// Given a parent process's page table, create a copy
+// of it for a child.
+pde_t*
+copyuvm(pde_t *pgdir, uint sz) //검토 완
+{
+  pde_t *d;
+
+  if((d = setupkvm()) == 0) //child의 pgdir값 생성
+    return 0;
+  if(copyuvmrange(pgdir, d, 0, sz, 0) < 0){
+    freevm(d);
+    return 0;
+  }
+  return d;
+}
+
+uint nr_cowfaults;  // private copies made by cowfault
+
+// Handle a write to a copy-on-write page at va: copy the frame
+// if it is still shared, or just make it writable again if this
+// is the last mapping.  Returns -1 if va is not a COW page.
+int
+cowfault(struct proc *p, uint va)
+{
+  pde_t *pgdir = p->pgdir;
+  struct page *pg;
+  pte_t *pte, old;
+  uint pa, flags;
+  char *mem;
+  int owner;
+
+  va = PGROUNDDOWN(va);
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (void*)va, 0)) == 0)
+    return -1;
+  old = *pte;
+  if((old & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(old);
+  flags = (PTE_FLAGS(old) & ~PTE_COW) | PTE_W;
+  pg = pa2page(pa);
+
+  acquire(&lru_lock);
+  if((*pte & ~(PTE_A|PTE_D)) != (old & ~(PTE_A|PTE_D))){
+    // Evicted or already resolved since we looked.
+    release(&lru_lock);
+    return 0;
+  }
+  if(pg->refcnt <= 1){
+    *pte = pa | flags;
+    release(&lru_lock);
+    lru_insert(P2V(pa), pgdir, (char*)va);
+    invlpg(va);
+    return 0;
+  }
+  release(&lru_lock);
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, P2V(pa), PGSIZE);
+
+  acquire(&lru_lock);
+  if((*pte & ~(PTE_A|PTE_D)) != (old & ~(PTE_A|PTE_D))){
+    // Evicted or already resolved while we were copying.
+    release(&lru_lock);
+    kfree(mem);
+    return 0;
+  }
+  *pte = V2P(mem) | flags;
+  owner = pg->pgdir == pgdir && pg->vaddr == (char*)va;
+  if(owner)
+    lru_unlink(pg);
+  if(pg->refcnt > 1){
+    pg->refcnt--;
+    if(owner)
+      lru_adopt(pg, pa, va);
+    pa = 0;
+  } else
+    pg->refcnt = 0;
+  nr_cowfaults++;
+  release(&lru_lock);
+
+  if(pa)
+    kfree(P2V(pa));  // the other mappings went away meanwhile
+  lru_insert(mem, pgdir, (char*)va);
+  invlpg(va);
+  return 0;
+}
+
+uint nr_zerofills;  // heap pages allocated on first touch
+
+// Back the never-touched heap page at va with a zeroed frame.
+// Returns -1 if va is outside the heap or already mapped.
+int
+lazyfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz || va >= KERNBASE)
+    return -1;
+  pte = walkpgdir(p->pgdir, (void*)va, 0);
+  if(pte && *pte != 0)
+    return -1;
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  lru_insert(mem, p->pgdir, (char*)va);
+  nr_zerofills++;
+  return 0;
+}
+
+// Page fault handler.  Returns 0 if the fault was resolved and
+// the faulting instruction can be restarted.
+int
+pgfault(struct proc *p, uint va, uint err)
+{
+  if((err & (FEC_PR|FEC_WR)) == (FEC_PR|FEC_WR))
+    return cowfault(p, va);
+  if(!(err & FEC_PR)){
+    if(swapin(p, va) == 0 || lazyfault(p, va) == 0)
+      return 0;
+    return mmapfault(p, va, err);
+  }
+  return -1;
+}
+
+// Fault in every page of [va, va+n) that the kernel could fault
+// on while copying to or from it: untouched heap and mapped pages,
+// swapped-out pages and, since the direction isn't known, shared
+// copy-on-write pages.  System calls do this from argptr() before
+// taking locks, as a fault under a spinlock can't sleep in the
+// disk or in reclaim.  Returns -1 if a page can't be brought in.
+int
+uvmprefault(struct proc *p, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if(p->pgdir[PDX(a)] & PTE_PS){
+      a = PGROUNDDOWN(a | (HUGEPGSIZE - 1));
+      continue;
+    }
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P)){
+      if((*pte & PTE_COW) && cowfault(p, a) < 0)
+        return -1;
+    } else if(pgfault(p, a, 0) < 0)
+      return -1;
+  }
+  return 0;
 }
 
 //PAGEBREAK!
@@ -447,115 +731,781 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 
 int
 print_len() {
-	int len;
-	struct page *temp;
-	struct page *first;
-
-	len = 0;
-	first = page_lru_head;
-	temp = page_lru_head;
-	while (1) {
-		len += 1;
-		temp = temp->next;
-		//cprintf("len is %d\n", len);
-		if (first == temp) 
-			break;
-		}
-
 	return num_lru_pages;
 	}
 
+// Reclaim scans the tail of the inactive list.  A page found
+// referenced there for the first time gets one more trip round
+// the list; referenced again, it is promoted to the active list.
+// Only unreferenced inactive pages are evicted, so a big buffer
+// that is streamed through once is pushed out without disturbing
+// pages in steady use.  While the active list is the longer one
+// its tail is aged too: unreferenced pages go back to the
+// inactive list, referenced ones round the active list again.
+
+uint nr_scanned;     // LRU pages looked at by reclaim
+uint nr_refaults, nr_wsrefaults;
+
+// Pages evicted so far, counted under lru_lock, and its value
+// when each swap slot's page was evicted.  The difference on
+// swap-in is the refault distance.
+static uint evictclock;
+static uint swapshadow[NSWAPSLOTS];
+
+uint nr_swapcached;  // pages with a swap cache slot
+
+// The PTE, or large-page PDE, mapping LRU page p.
+static pte_t*
+lru_pte(struct page *p)
+{
+    pde_t *pde = &p->pgdir[PDX(p->vaddr)];
+
+    if (*pde & PTE_PS)
+        return pde;
+    return walkpgdir(p->pgdir, p->vaddr, 0);
+}
+
+// Age one page from the tail of the active list.
+// Caller must hold lru_lock.
+static void
+lru_age(void)
+{
+    struct page *p = lru_active.head->prev;
+    pte_t *pte = lru_pte(p);
+
+    nr_scanned++;
+    if (*pte & PTE_A) {
+        __sync_fetch_and_and(pte, ~PTE_A);
+        lru_rotate(p);
+    } else
+        lru_deactivate(p);
+}
+
+// Evict up to SWAP_CLUSTER cold pages from the inactive list in
+// one pass, give them adjacent swap slots where possible and write
+// them out together.  A page still in the swap cache that has not
+// been written to since (PTE_D clear) is dropped without a write,
+// and an all-zero page becomes a PTE_ZERO entry with no slot.
+// The write is only queued: the written frames are freed when it
+// completes (see swapwb_start()).  Returns one of the frames that
+// could be freed at once (clean, zero, or taken by the compressed
+// pool) to the caller, and puts the rest back on the free list;
+// returns 0 if every victim is still being written.  Victims may
+// belong to processes running on other CPUs, so their TLB entries
+// are shot down, as one batch, before the write.
+#define SWAP_CLUSTER 16
+
+uint nr_evicted;  // pages swapped out so far
+uint nr_cleanevicts, nr_zeroevicts;
+
+static int
+pagezero(char *mem)
+{
+    uint *p = (uint*)mem;
+    int i;
+
+    for (i = 0; i < PGSIZE / sizeof(uint); i++)
+        if (p[i])
+            return 0;
+    return 1;
+}
+
+static int
+inlist(struct page *p, struct page **list, int n)
+{
+    while (n-- > 0)
+        if (list[n] == p)
+            return 1;
+    return 0;
+}
+
 char*
 swapout() {
-    pte_t *pte;
-    uint flags;
-    uint pa;
-    int blkno;
-    uint find = 0;
+    struct page *temp;
+    char *frames[SWAP_CLUSTER], *clean[SWAP_CLUSTER], *r;
+    int slots[SWAP_CLUSTER];
+    struct tlbbatch tb;
+    struct page *dirtied[SWAP_CLUSTER];
+    pte_t *pte, *pt, old;
+    int n, nc, nz, nd, w, i, j, z, base, scan;
 
-    struct page *temp = page_lru_head;
-    if (num_lru_pages == 0)
+    tlbinit(&tb);
+    acquire(&lru_lock);
+    if (num_lru_pages == 0) {
+        release(&lru_lock);
         return 0;
+    }
 
-    while (find == 0) {
-        pte = walkpgdir(temp->pgdir, (void*)temp->vaddr, 0);
-        pa = PTE_ADDR(*pte);
-        flags = PTE_FLAGS(*pte);
+    // Reserve a run of slots up front; fall back to single
+    // slots if swap is too fragmented.
+    base = find_bitmap_run(SWAP_CLUSTER);
 
-        if (flags & PTE_A) {
-            *pte &= ~PTE_A;
-            page_lru_head = temp->next;
-        } else {
-		
-            blkno = find_bitmap();
-            if (blkno == -1) {
-                return 0;
+    // Every page is seen at most twice with PTE_A clear on the way,
+    // so this many steps are enough to find a victim.  Clearing
+    // PTE_A needs no shootdown; a stale TLB entry only keeps the
+    // CPU from setting it again, which makes the page look colder.
+    n = nc = nz = nd = 0;
+    scan = 2 * num_lru_pages + 1;
+    while (n + nc < SWAP_CLUSTER && num_lru_pages > 0 && scan-- > 0) {
+        if (lru_inactive.n < lru_active.n)
+            lru_age();
+        if (lru_inactive.n == 0)
+            continue;
+        temp = lru_inactive.head->prev;
+        pte = lru_pte(temp);
+        nr_scanned++;
+
+        if (*pte & PTE_A) {
+            __sync_fetch_and_and(pte, ~PTE_A);
+            if (temp->flags & PG_REFERENCED)
+                lru_activate(temp);
+            else {
+                temp->flags |= PG_REFERENCED;
+                lru_rotate(temp);
             }
-            set_bitmap(blkno, 1);
-            *pte = blkno << 1;
-	    
-            swapwrite((char*)P2V(pa), blkno);
-            lru_delete((char*)P2V(pa), temp->pgdir, temp->vaddr);
-            find = 1;
+        } else if (*pte & PTE_PS) {
+            // A cold large page: break it up and carry on
+            // scanning through its 4 KB pieces.
+            if ((pt = (pte_t*)kalloc_nowait()) != 0) {
+                hugesplit(temp->pgdir, (uint)temp->vaddr, pt);
+                tlbadd(&tb, temp->pgdir, (uint)temp->vaddr);
+                scan += NPTENTRIES;
+            } else
+                lru_rotate(temp);
+        } else if (temp->refcnt > 1) {
+            // Shared copy-on-write: only this one mapping is
+            // known, so the frame can't be unmapped everywhere.
+            // Keep it out of the way on the active list.
+            lru_activate(temp);
+        } else if ((z = pagezero(P2V(PTE_ADDR(old = *pte)))) &&
+                   !(old & PTE_D) && !inlist(temp, dirtied, nd) &&
+                   cmpxchg(pte, old, PTE_ZERO) == old) {
+            // All zeros, and not written since PTE_D was last
+            // clear (a write now would make the exchange fail):
+            // it needs neither a slot nor a write.
+            swapcache_free(temp);
+            clean[nc++] = P2V(PTE_ADDR(old));
+            nz++;
+            tlbadd(&tb, temp->pgdir, (uint)temp->vaddr);
+            lru_unlink(temp);
+        } else if (z && (old & PTE_D) && nd < SWAP_CLUSTER) {
+            // All zeros but written to, maybe still through a
+            // dirty TLB entry.  Clear PTE_D and look again on a
+            // later pass, after the shootdown below.
+            swapcache_free(temp);
+            __sync_fetch_and_and(pte, ~PTE_D);
+            tlbadd(&tb, temp->pgdir, (uint)temp->vaddr);
+            dirtied[nd++] = temp;
+            lru_rotate(temp);
+        } else if (temp->swapslot && !(old & PTE_D) &&
+                   cmpxchg(pte, old, temp->swapslot << 1) == old) {
+            // Clean, and the swap slot still has its contents.
+            // The exchange fails if a CPU dirtied the page since
+            // we looked.
+            swapshadow[temp->swapslot] = evictclock++;
+            temp->swapslot = 0;
+            __sync_fetch_and_sub(&nr_swapcached, 1);
+            clean[nc++] = P2V(PTE_ADDR(old));
+            tlbadd(&tb, temp->pgdir, (uint)temp->vaddr);
+            lru_unlink(temp);
+        } else {
+            // The cached copy, if any, is stale.
+            swapcache_free(temp);
+            if (base >= 0)
+                slots[n] = base + n;
+            else if ((slots[n] = find_bitmap()) == -1)
+                break;
+            swap_iostart(slots[n]);
+            frames[n] = P2V(PTE_ADDR(*pte));
+            *pte = slots[n] << 1;
+            swapshadow[slots[n]] = evictclock++;
+            tlbadd(&tb, temp->pgdir, (uint)temp->vaddr);
+            lru_unlink(temp);
+            n++;
         }
-        temp = temp->next;
     }
+    release(&lru_lock);
+    tlbflush(&tb);
+
+    if (base >= 0)
+        for (i = n; i < SWAP_CLUSTER; i++)
+            set_bitmap(base + i, 0);
+    if (n + nc == 0)
+        return 0;
+
+    // Offer each page to the compressed pool first, and move the
+    // ones it doesn't take to the front, in order.
+    for (i = w = 0; i < n; i++) {
+        if (zswap_store(slots[i], frames[i]) == 0)
+            continue;
+        r = frames[w], frames[w] = frames[i], frames[i] = r;
+        j = slots[w], slots[w] = slots[i], slots[i] = j;
+        w++;
+    }
+
+    // The pages the pool took need no write.
+    for (i = w; i < n; i++)
+        swap_iodone(slots[i]);
+
+    // Queue one write for each run of consecutive slots.
+    for (i = 0; i < w; i = j) {
+        for (j = i + 1; j < w && slots[j] == slots[j-1] + 1; j++)
+            ;
+        swapwb_start(&frames[i], j - i, slots[i]);
+    }
+    nr_evicted += n + nc;
+    nr_cleanevicts += nc - nz;
+    nr_zeroevicts += nz;
+
+    for (i = 0; i < nc; i++)
+        frames[n + i] = clean[i];
+    r = 0;
+    for (i = w; i < n + nc; i++) {
+        if (r == 0)
+            r = frames[i];
+        else
+            kfree(frames[i]);
+    }
+    return r;
+}
+
+// Turn the 4 MB mapping at va in pgdir into a page table of 4 KB
+// PTEs for the same frame, using the page pt.  Nothing is copied,
+// so the owner can keep running on the memory throughout.  The
+// large page's LRU entry is replaced by one per 4 KB page, at the
+// head of the inactive list.  Caller must hold lru_lock, and invalidate
+// va in the TLBs afterwards.
+void
+hugesplit(pde_t *pgdir, uint va, pte_t *pt)
+{
+  pde_t *pde;
+  uint pa, perm;
+  int i;
+
+  pde = &pgdir[PDX(va)];
+  pa = PTE_ADDR(*pde);
+  // Keep PTE_D: the owner may still write through a dirty 4 MB
+  // TLB entry without setting it in the new PTEs.
+  perm = PTE_FLAGS(*pde) & ~(PTE_PS|PTE_A);
+  for(i = 0; i < NPTENTRIES; i++)
+    pt[i] = (pa + i*PGSIZE) | perm;
+  lru_unlink(pa2page(pa));
+  *pde = V2P(pt) | PTE_P | PTE_W | PTE_U;
+  for(i = NPTENTRIES - 1; i >= 0; i--)
+    lru_link(pa2page(pa + i*PGSIZE), pgdir, (char*)va + i*PGSIZE);
+  hugerelease();
+}
+
+// Split every large page in [start, end) of pgdir, e.g. before
+// fork copies the range one 4 KB PTE at a time.
+int
+hugesplitrange(pde_t *pgdir, uint start, uint end)
+{
+  struct tlbbatch tb;
+  pte_t *pt;
+  uint a;
+
+  tlbinit(&tb);
+  for(a = start; a < end; a += HUGEPGSIZE){
+    if(!(pgdir[PDX(a)] & PTE_PS))
+      continue;
+    if((pt = (pte_t*)kalloc()) == 0){
+      tlbflush(&tb);
+      return -1;
+    }
+    acquire(&lru_lock);
+    if(pgdir[PDX(a)] & PTE_PS){
+      hugesplit(pgdir, a, pt);
+      tlbadd(&tb, pgdir, a);
+      pt = 0;
+    }
+    release(&lru_lock);
+    if(pt)
+      kfree((char*)pt);
+  }
+  tlbflush(&tb);
+  return 0;
+}
+
+// Swap readahead statistics.
+uint ra_pages, ra_hits, ra_wasted;
+
+// Score p's last readahead: pages touched since then (PTE_A set)
+// were hits.  A fully used window doubles, a mostly wasted one
+// halves.
+static void
+ra_account(struct proc *p) {
+    pte_t *pte;
+    int i, hits;
+
+    if (p->ra_n == 0)
+        return;
+    hits = 0;
+    for (i = 0; i < p->ra_n; i++) {
+        pte = walkpgdir(p->pgdir, (void*)(p->ra_va + i * PGSIZE), 0);
+        if (pte && (*pte & PTE_P) && (*pte & PTE_A))
+            hits++;
+    }
+    ra_hits += hits;
+    ra_wasted += p->ra_n - hits;
+    if (hits == p->ra_n && p->ra_window < SWAPRA_MAX)
+        p->ra_window *= 2;
+    else if (hits < p->ra_n / 2 && p->ra_window > 1)
+        p->ra_window /= 2;
+    p->ra_n = 0;
+}
+
+uint nr_zeroins;  // PTE_ZERO pages faulted back in
+
+// Map a zeroed frame at va, which was swapped out as a zero page.
+static int
+zeroin(struct proc *p, uint va, pte_t *pte)
+{
+    struct vma *v;
+    char *mem;
 
-    return (char*)P2V(pa);
+    if ((mem = kalloc_zeroed()) == 0)
+        return -1;
+    *pte = V2P(mem) | PTE_U | PTE_P;
+    v = mmapfind(p, va);
+    if (v == 0 || (v->prot & PROT_WRITE))
+        *pte |= PTE_W;
+    lru_insert(mem, p->pgdir, (char*)va);
+    nr_zeroins++;
+    return 0;
 }
 
-void swapin(struct proc *p, uint vaddr) {
+// Bring the swapped-out page at vaddr back in, along with up to
+// p->ra_window following pages whose swap slots come right after
+// it, in one disk read.  Returns -1 if vaddr is not swapped out.
+int swapin(struct proc *p, uint vaddr) {
+    char *frames[SWAPRA_MAX + 1];
+    struct page *pg;
+    struct vma *v;
     pde_t *d;
+    pte_t *pte;
+    uint slot, va;
+    int n, i, keep;
+
     d = p->pgdir;
-    pte_t *pte = walkpgdir(d, (void*)vaddr, 0);
-    uint offset = (uint)*pte;
+    vaddr = PGROUNDDOWN(vaddr);
+    if (vaddr >= KERNBASE)
+        return -1;
+    pte = walkpgdir(d, (void*)vaddr, 0);
+    if (pte == 0 || (*pte & PTE_P))
+        return -1;
+    if (*pte == PTE_ZERO)
+        return zeroin(p, vaddr, pte);
+    slot = *pte >> 1;
+    if (!check_bitmap(slot))
+        return -1;
 
-    if (!(offset & PTE_P)) {
-        offset = offset >> 1;
-        char* mem = kalloc();
-        swapread(mem, offset);
-        set_bitmap(offset, 0);
+    ra_account(p);
 
-        *pte = V2P(mem) | PTE_U | PTE_W | PTE_P;
-        lru_insert(mem, d, (char*)vaddr);
+    // Don't read ahead into memory we would have to reclaim, when
+    // the page is in the compressed pool, or past pages that are
+    // still being written out and so are still in memory.
+    n = 1;
+    if (freemem() > 2 * SWAPRA_MAX && !zswap_has(slot) && !swap_iobusy(slot)) {
+        for (va = vaddr + PGSIZE; n <= p->ra_window && va < p->sz; va += PGSIZE, n++) {
+            pte_t *q = walkpgdir(d, (void*)va, 0);
+            if (q == 0 || (*q & PTE_P) || (*q >> 1) != slot + n ||
+                !check_bitmap(slot + n) || zswap_has(slot + n) ||
+                swap_iobusy(slot + n))
+                break;
+        }
     }
-}
 
-void set_bitmap(int blkno, int swap_flag) {
-    if (bitmap == 0) {
-        bitmap = kalloc();
-        memset(bitmap, 0, PGSIZE);
+    for (i = 0; i < n; i++) {
+        if ((frames[i] = kalloc()) == 0) {
+            if (i == 0)
+                return -1;
+            n = i;
+            break;
+        }
     }
-    int idx = blkno / 8;
-    int pos = blkno % 8;
+    if (n > 1 || swapwb_copy(slot, frames[0]) < 0) {
+        for (i = 0; i < n; i++)
+            swap_iowait(slot + i);
+        if (n > 1 || zswap_load(slot, frames[0]) < 0)
+            swapreadv(frames, n, slot);
+    }
+
+    // Keep the slots, so the pages can be dropped again without
+    // a write if they stay clean, unless swap is filling up.
+    keep = num_swap_pages < NSWAPSLOTS / 2;
+
+    // Read-only mappings stay read-only; readahead never leaves
+    // the heap, so only the faulting page can be in one.
+    v = mmapfind(p, vaddr);
+    for (i = 0; i < n; i++) {
+        va = vaddr + i * PGSIZE;
+        pte = walkpgdir(d, (void*)va, 0);
+        pg = pa2page(V2P(frames[i]));
+        if (keep) {
+            pg->swapslot = slot + i;
+            __sync_fetch_and_add(&nr_swapcached, 1);
+        } else
+            set_bitmap(slot + i, 0);
+        *pte = V2P(frames[i]) | PTE_U | PTE_P;
+        if (v == 0 || (v->prot & PROT_WRITE))
+            *pte |= PTE_W;
+        acquire(&lru_lock);
+        lru_link(pg, d, (char*)va);
+        if (i == 0) {
+            // Evicted fewer pages ago than there are active pages:
+            // a shorter active list would have kept it, so treat
+            // it as part of the working set.
+            nr_refaults++;
+            if (evictclock - swapshadow[slot] <= lru_active.n) {
+                nr_wsrefaults++;
+                lru_activate(pg);
+            }
+        }
+        release(&lru_lock);
+    }
+
+    p->ra_va = vaddr + PGSIZE;
+    p->ra_n = n - 1;
+    ra_pages += n - 1;
+    return 0;
+}
+
+// Swap slot allocator.  swapmap has one bit per slot (1 = in use);
+// bit i of swapfull is set when swapmap word i has no free slot,
+// so a free slot is found with two bit scans.  Allocation is
+// next-fit from swapcursor so slots are handed out round-robin
+// instead of piling up at the front of the swap area.
+#define SWAPWORDS    ((NSWAPSLOTS + 31) / 32)
+#define SWAPSUMWORDS ((SWAPWORDS + 31) / 32)
+
+// Lock order: lru_lock, then swaplock, then ptable.lock, which
+// sleep() and wakeup() take while swaplock is held.  So nothing
+// may free user memory with ptable.lock held; wait() frees a
+// child's page table after releasing it.
+static struct spinlock swaplock;
+static uint swapmap[SWAPWORDS];
+static uint swapfull[SWAPSUMWORDS];
+static uint swapcursor;
+
+// Slots with a write in flight, and slots freed during one whose
+// release has to wait for it to finish.
+static uint swapbusy[SWAPWORDS];
+static uint swapdefer[SWAPWORDS];
+
+// Extra references to each slot from PTEs copied by fork.
+// A slot is freed only when the last reference is dropped.
+static uchar swapref[NSWAPSLOTS];
+
+// Mark the slots past NSWAPSLOTS as used so they are never
+// handed out.  Slot 0 is reserved too: a swapped-out PTE of
+// slot 0 would be indistinguishable from an empty PTE.
+void
+swapinit(void)
+{
+    uint i;
+
+    initlock(&swaplock, "swap");
+    for (i = NSWAPSLOTS; i < SWAPWORDS * 32; i++)
+        swapmap[i / 32] |= 1 << (i % 32);
+    for (i = SWAPWORDS; i < SWAPSUMWORDS * 32; i++)
+        swapfull[i / 32] |= 1 << (i % 32);
+    if (swapmap[SWAPWORDS - 1] == ~0)
+        swapfull[(SWAPWORDS - 1) / 32] |= 1 << ((SWAPWORDS - 1) % 32);
+    swapmap[0] |= 1;
+}
+
+// Caller must hold swaplock.
+static void
+swapmap_set(int blkno, int swap_flag)
+{
+    uint w = blkno / 32;
+    uint bit = 1 << (blkno % 32);
 
     if (swap_flag) {
-        bitmap[idx] = bitmap[idx] | (1 << pos);
+        if (swapmap[w] & bit)
+            return;
+        swapmap[w] |= bit;
+        num_swap_pages++;
+        if (swapmap[w] == ~0)
+            swapfull[w / 32] |= 1 << (w % 32);
     } else {
-        bitmap[idx] = bitmap[idx] & (~(1 << pos));
+        if (!(swapmap[w] & bit))
+            return;
+        swapmap[w] &= ~bit;
+        num_swap_pages--;
+        zswap_invalidate(blkno);
+        swapfull[w / 32] &= ~(1 << (w % 32));
     }
-    //swap 될때 1로 바꾸고, swap in 될때 다시 0으로 세팅
 }
-int find_bitmap() {
-    for (int i = 0; i < PGSIZE; i++) {
-        if (bitmap[i] != 0xFF) {
-            for (int j = 0; j < 8; j++) {
-                if (!(bitmap[i] & (1 << j))) {
-                    return i * 8 + j;
-                }
+
+//swap 될때 1로 바꾸고, swap in 될때 다시 0으로 세팅
+// Clearing a shared slot only drops one reference.
+void set_bitmap(int blkno, int swap_flag) {
+    uint w = blkno / 32;
+    uint bit = 1 << (blkno % 32);
+
+    if (blkno <= 0 || blkno >= NSWAPSLOTS)
+        panic("set_bitmap");
+    acquire(&swaplock);
+    if (!swap_flag && swapref[blkno] > 0)
+        swapref[blkno]--;
+    else if (!swap_flag && (swapbusy[w] & bit))
+        swapdefer[w] |= bit;
+    else
+        swapmap_set(blkno, swap_flag);
+    release(&swaplock);
+}
+
+// Release page pg's swap cache slot, if it has one, e.g. because
+// the frame is being freed or its contents changed.
+void
+swapcache_free(struct page *pg)
+{
+    uint slot;
+
+    if ((slot = pg->swapslot) == 0)
+        return;
+    pg->swapslot = 0;
+    __sync_fetch_and_sub(&nr_swapcached, 1);
+    set_bitmap(slot, 0);
+}
+
+// Add a reference to the in-use slot blkno for a PTE copied
+// by fork.
+void swap_dup(int blkno) {
+    acquire(&swaplock);
+    if (!check_bitmap(blkno) || swapref[blkno] == 0xff)
+        panic("swap_dup");
+    swapref[blkno]++;
+    release(&swaplock);
+}
+
+// Mark slot blkno as being written.  Faults on the slot wait in
+// swap_iowait() until swap_iodone() so they don't read the slot
+// before its contents reach the disk.
+void swap_iostart(int blkno) {
+    acquire(&swaplock);
+    swapbusy[blkno / 32] |= 1 << (blkno % 32);
+    release(&swaplock);
+}
+
+// swap_iostart() for a slot nobody else is writing, e.g. one
+// moving from the compressed pool to disk.  Returns 0 if blkno
+// is free or already busy.
+int swap_trystart(int blkno) {
+    uint w = blkno / 32;
+    uint bit = 1 << (blkno % 32);
+    int ok;
+
+    acquire(&swaplock);
+    ok = (swapmap[w] & bit) && !(swapbusy[w] & bit);
+    if (ok)
+        swapbusy[w] |= bit;
+    release(&swaplock);
+    return ok;
+}
+
+void swap_iodone(int blkno) {
+    uint w = blkno / 32;
+    uint bit = 1 << (blkno % 32);
+
+    acquire(&swaplock);
+    swapbusy[w] &= ~bit;
+    if (swapdefer[w] & bit) {
+        swapdefer[w] &= ~bit;
+        swapmap_set(blkno, 0);
+    }
+    wakeup(&swapbusy[w]);
+    release(&swaplock);
+}
+
+void swap_iowait(int blkno) {
+    uint w = blkno / 32;
+    uint bit = 1 << (blkno % 32);
+
+    acquire(&swaplock);
+    while (swapbusy[w] & bit)
+        sleep(&swapbusy[w], &swaplock);
+    release(&swaplock);
+}
+
+// Is a write to slot blkno in flight?  Only a hint: no lock.
+int swap_iobusy(int blkno) {
+    return (swapbusy[blkno / 32] >> (blkno % 32)) & 1;
+}
+
+// Background swap writes.  swapout() hands each run of pages it
+// evicts to swapwb_start(), which queues the write and returns;
+// the frames go back to the free list from the disk interrupt,
+// in swapwb_done().  Until then the slots stay busy, and a fault
+// on one copies the page from the frame being written instead of
+// waiting to read it back.  At most NSWAPIO writes are in flight;
+// beyond that swapwb_start() waits, which keeps reclaim from
+// running far ahead of the disk.
+#define NSWAPIO 8
+
+struct swapio {
+    struct buf b;               // first, so swapwb_done() can find us
+    char *frames[SWAP_CLUSTER];
+    int slot;                   // frames[i] goes to slot + i
+    int n;                      // frames; 0 once the write is done
+    int busy;
+};
+
+static struct swapio swapio[NSWAPIO];
+static uint swapio_done;        // writes finished, for swapwb_wait()
+uint nr_writeback;              // pages in swapio[]
+uint nr_wbfaults;               // faults served by swapwb_copy()
+
+// Called from ideintr() when io's write is done.
+static void
+swapwb_done(struct buf *b)
+{
+    struct swapio *io = (struct swapio*)b;
+    int i, n;
+
+    // Stop faults copying from the frames before the slots can
+    // be freed and handed out again.
+    acquire(&swaplock);
+    n = io->n;
+    io->n = 0;
+    release(&swaplock);
+
+    for (i = 0; i < n; i++)
+        swap_iodone(io->slot + i);
+    for (i = 0; i < n; i++)
+        kfree_nocache(io->frames[i]);
+
+    acquire(&swaplock);
+    io->busy = 0;
+    nr_writeback -= n;
+    swapio_done++;
+    wakeup(swapio);
+    release(&swaplock);
+}
+
+// Write the n evicted pages frames[] to slots slot..slot+n-1,
+// which must be busy (swap_iostart()), and free them once they
+// are on disk.  Only waits if too many writes are in flight.
+void
+swapwb_start(char **frames, int n, int slot)
+{
+    struct swapio *io;
+    int i;
+
+    acquire(&swaplock);
+    for (io = 0; io == 0; ) {
+        for (i = 0; i < NSWAPIO; i++)
+            if (!swapio[i].busy) {
+                io = &swapio[i];
+                break;
             }
+        if (io == 0)
+            sleep(swapio, &swaplock);
+    }
+    io->busy = 1;
+    io->slot = slot;
+    io->n = n;
+    memmove(io->frames, frames, n * sizeof(frames[0]));
+    nr_writeback += n;
+    release(&swaplock);
+
+    swapwritev_async(&io->b, io->frames, n, slot, swapwb_done);
+}
+
+// If slot blkno is still being written, copy its page to mem
+// and return 0.  Returns -1 if the page must come from swap.
+int
+swapwb_copy(int blkno, char *mem)
+{
+    struct swapio *io;
+
+    acquire(&swaplock);
+    for (io = swapio; io < swapio + NSWAPIO; io++) {
+        if (io->n && blkno >= io->slot && blkno < io->slot + io->n) {
+            memmove(mem, io->frames[blkno - io->slot], PGSIZE);
+            nr_wbfaults++;
+            release(&swaplock);
+            return 0;
         }
     }
+    release(&swaplock);
     return -1;
 }
-int check_bitmap(int blkno) {
-	if (bitmap == 0) {
-		bitmap = kalloc();
-		memset(bitmap, 0, PGSIZE);
-			
-	}
-	int idx = blkno / 8;
-	int pos = blkno % 8;
 
-	return (bitmap[idx] & (1 << pos)) ? 1 : 0;
+// Wait for a background swap write to finish and free its
+// frames.  Returns -1 at once if none is in flight.
+int
+swapwb_wait(void)
+{
+    uint done;
+
+    acquire(&swaplock);
+    if (nr_writeback == 0) {
+        release(&swaplock);
+        return -1;
+    }
+    done = swapio_done;
+    while (swapio_done == done)
+        sleep(swapio, &swaplock);
+    release(&swaplock);
+    return 0;
+}
+
+// Find a free swap slot and mark it in use.
+// Returns the slot number, or -1 if swap is full.
+int find_bitmap() {
+    uint i, s, w, bits;
+    int blkno = -1;
+
+    acquire(&swaplock);
+    // The last round revisits the cursor's summary word
+    // to pick up the words below the cursor.
+    for (i = 0; i <= SWAPSUMWORDS; i++) {
+        s = (swapcursor / 32 + i) % SWAPSUMWORDS;
+        bits = ~swapfull[s];
+        if (i == 0)
+            bits &= ~0U << (swapcursor % 32);
+        if (bits == 0)
+            continue;
+        w = s * 32 + bsf(bits);
+        blkno = w * 32 + bsf(~swapmap[w]);
+        swapmap_set(blkno, 1);
+        swapcursor = w;
+        break;
+    }
+    release(&swaplock);
+    return blkno;
+}
+
+// Find n (at most 32) consecutive free swap slots within one
+// bitmap word and mark them in use.  Returns the first slot,
+// or -1 if there is no such run.
+int find_bitmap_run(int n) {
+    uint i, w, x, free;
+    int k, blkno = -1;
+
+    acquire(&swaplock);
+    for (i = 0; i < SWAPWORDS; i++) {
+        w = (swapcursor + i) % SWAPWORDS;
+        free = ~swapmap[w];
+        for (x = free, k = 1; k < n && x; k++)
+            x &= free >> k;
+        if (x == 0)
+            continue;
+        blkno = w * 32 + bsf(x);
+        for (k = 0; k < n; k++)
+            swapmap_set(blkno + k, 1);
+        swapcursor = w;
+        break;
+    }
+    release(&swaplock);
+    return blkno;
+}
+
+int check_bitmap(int blkno) {
+	if (blkno <= 0 || blkno >= NSWAPSLOTS)
+		return 0;
+	return (swapmap[blkno / 32] >> (blkno % 32)) & 1;
 	}
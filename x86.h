@@ -130,6 +130,39 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Low 32 bits of the time-stamp counter.
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
+// Store newval at addr if it still holds old.
+// Returns what addr held.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc", "memory");
+  return result;
+}
+
+// Index of the least significant set bit of x; x must be non-zero.
+static inline uint
+bsf(uint x)
+{
+  uint r;
+  asm("bsfl %1,%0" : "=r" (r) : "rm" (x) : "cc");
+  return r;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +177,21 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
+// Drop the TLB entry (4 KB or 4 MB) that maps va.
+static inline void
+invlpg(uint va)
+{
+  asm volatile("invlpg (%0)" : : "r" (va) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
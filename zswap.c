@@ -0,0 +1,424 @@
+// Compressed swap cache.
+//
+// An optional tier in front of the swap area.  swapout() offers
+// every page it evicts to zswap_store(), which compresses it with
+// a small LZ77 coder and keeps the result in a pool of kernel
+// pages.  The page's swap slot stays allocated, but nothing is
+// written to it; swapin() asks zswap_load() before going to the
+// disk.  When the pool is at its limit, the objects of one pool
+// page (round robin) are decompressed and written to their slots
+// to make room.  An entry goes away when its slot is freed.
+//
+// Each pool page holds objects of one size class, 128 to 2048
+// bytes; a page that doesn't compress into 2048 bytes goes
+// straight to disk.  The pool is off until memctl(MC_ZSWAP, n)
+// allows it n pages.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "memstat.h"
+
+#define ZMINSHIFT  7                        // smallest object is 128 bytes
+#define ZNCLASS    5                        // 128, 256, ..., 2048
+#define ZMAXOBJ    (1 << (ZMINSHIFT + ZNCLASS - 1))
+#define ZHASHBITS  10
+
+// Start of each object in the pool.
+struct zhdr {
+  uint slot;
+  ushort len;     // compressed bytes that follow
+};
+
+struct zpage {
+  char *mem;      // pool page, or 0
+  int class;
+  uint used;      // objects in use, one bit each
+};
+
+static struct {
+  struct spinlock lock;
+  int maxpages;                   // pool limit; 0 = off
+  int npages;
+  int cursor;                     // next pool page to write back
+  int wbbusy;                     // a writeback is running
+  struct zpage pages[ZSWAPPAGES];
+  ushort hash[1 << ZHASHBITS];    // lz_compress() state
+  uchar buf[ZMAXOBJ];             // and output
+  uint stored;                    // pages in the pool
+  uint bytes;                     // their compressed size
+  uint stores, loads, misses, rejects, writeback;
+  uint compkc, decompkc;          // time spent, in 1024-cycle units
+} zswap;
+
+// Pool object handle of each swap slot, plus one; 0 = on disk.
+static uint ztab[NSWAPSLOTS];
+
+static char wbpage[PGSIZE];       // writeback staging, under wbbusy
+
+void
+zswapinit(void)
+{
+  initlock(&zswap.lock, "zswap");
+}
+
+//PAGEBREAK!
+// The coder.  The output is a sequence of
+//   0lllllll                literal run: l+1 bytes follow
+//   1nnnoooo oooooooo [x]   copy n+3 bytes from o bytes back;
+//                           n = 7 means x+10 bytes instead
+// Matches are found through a hash table of 3-byte prefixes.
+
+static uint
+lz_hash(uchar *p)
+{
+  uint v = p[0] | p[1] << 8 | p[2] << 16;
+
+  return (v * 2654435761U) >> (32 - ZHASHBITS);
+}
+
+// Emit the literals src[from..to) at dst+op.
+// Returns the new op, or -1 if they don't fit in max bytes.
+static int
+lz_literals(uchar *src, int from, int to, uchar *dst, int op, int max)
+{
+  int n;
+
+  while(from < to){
+    n = to - from;
+    if(n > 128)
+      n = 128;
+    if(op + 1 + n > max)
+      return -1;
+    dst[op++] = n - 1;
+    memmove(dst + op, src + from, n);
+    op += n;
+    from += n;
+  }
+  return op;
+}
+
+// Compress the page src into at most max bytes at dst.
+// Returns the compressed size, or -1 if it doesn't fit.
+static int
+lz_compress(uchar *src, uchar *dst, int max)
+{
+  int ip, op, lit, ref, off, len, h;
+
+  memset(zswap.hash, 0, sizeof(zswap.hash));
+  ip = op = lit = 0;
+  while(ip + 3 <= PGSIZE){
+    h = lz_hash(src + ip);
+    ref = zswap.hash[h] - 1;      // stored plus one; 0 = empty
+    zswap.hash[h] = ip + 1;
+    off = ip - ref;
+    if(ref < 0 || off >= 4096 || src[ref] != src[ip] ||
+       src[ref+1] != src[ip+1] || src[ref+2] != src[ip+2]){
+      ip++;
+      continue;
+    }
+    if((op = lz_literals(src, lit, ip, dst, op, max)) < 0)
+      return -1;
+    for(len = 3; ip + len < PGSIZE && len < 265; len++)
+      if(src[ref+len] != src[ip+len])
+        break;
+    if(op + 3 > max)
+      return -1;
+    if(len < 10)
+      dst[op++] = 0x80 | (len - 3) << 4 | off >> 8;
+    else
+      dst[op++] = 0xF0 | off >> 8;
+    dst[op++] = off;
+    if(len >= 10)
+      dst[op++] = len - 10;
+    ip += len;
+    lit = ip;
+  }
+  return lz_literals(src, lit, PGSIZE, dst, op, max);
+}
+
+// Expand n bytes at src into the page dst.
+static int
+lz_decompress(uchar *src, int n, uchar *dst)
+{
+  int ip, op, c, len, off;
+
+  ip = op = 0;
+  while(ip < n){
+    c = src[ip++];
+    if(c < 0x80){
+      len = c + 1;
+      if(ip + len > n || op + len > PGSIZE)
+        return -1;
+      memmove(dst + op, src + ip, len);
+      ip += len;
+      op += len;
+      continue;
+    }
+    if(ip >= n)
+      return -1;
+    off = (c & 0xF) << 8 | src[ip++];
+    len = ((c >> 4) & 7) + 3;
+    if(len == 10){
+      if(ip >= n)
+        return -1;
+      len += src[ip++];
+    }
+    if(off == 0 || off > op || op + len > PGSIZE)
+      return -1;
+    for(; len > 0; len--, op++)    // may overlap
+      dst[op] = dst[op - off];
+  }
+  return op == PGSIZE ? 0 : -1;
+}
+
+//PAGEBREAK!
+// The pool.  A handle is pool page * 32 + object.
+
+static struct zhdr*
+zobj(uint h)
+{
+  struct zpage *zp = &zswap.pages[h / 32];
+
+  return (struct zhdr*)(zp->mem + ((h % 32) << (zp->class + ZMINSHIFT)));
+}
+
+// Allocate an object of the given class.
+// Returns its handle, or -1 if the pool is full.
+static int
+zalloc(int class)
+{
+  struct zpage *zp, *empty;
+  int n, k;
+
+  n = PGSIZE >> (class + ZMINSHIFT);
+  empty = 0;
+  for(zp = zswap.pages; zp < &zswap.pages[ZSWAPPAGES]; zp++){
+    if(zp->mem == 0){
+      if(empty == 0)
+        empty = zp;
+      continue;
+    }
+    if(zp->class != class || zp->used == (n == 32 ? ~0U : (1U << n) - 1))
+      continue;
+    k = bsf(~zp->used);
+    zp->used |= 1 << k;
+    return (zp - zswap.pages) * 32 + k;
+  }
+  if(empty == 0 || zswap.npages >= zswap.maxpages)
+    return -1;
+  if((empty->mem = kalloc_nowait()) == 0)
+    return -1;
+  zswap.npages++;
+  empty->class = class;
+  empty->used = 1;
+  return (empty - zswap.pages) * 32;
+}
+
+static void
+zfree(uint h)
+{
+  struct zpage *zp = &zswap.pages[h / 32];
+
+  zswap.stored--;
+  zswap.bytes -= zobj(h)->len;
+  zp->used &= ~(1 << (h % 32));
+  if(zp->used == 0){
+    kfree(zp->mem);
+    zp->mem = 0;
+    zswap.npages--;
+  }
+}
+
+//PAGEBREAK!
+// Write the objects of one pool page to their swap slots and
+// free them.
+static void
+zswap_writeback(void)
+{
+  char *wb = wbpage;
+  struct zhdr *z;
+  uint h, slot;
+  int i, pi, k;
+
+  acquire(&zswap.lock);
+  if(zswap.wbbusy || zswap.npages == 0){
+    release(&zswap.lock);
+    return;
+  }
+  zswap.wbbusy = 1;
+  pi = 0;
+  for(i = 0; i < ZSWAPPAGES; i++){
+    pi = (zswap.cursor + i) % ZSWAPPAGES;
+    if(zswap.pages[pi].mem)
+      break;
+  }
+  zswap.cursor = (pi + 1) % ZSWAPPAGES;
+  release(&zswap.lock);
+
+  for(k = 0; k < 32; k++){
+    acquire(&zswap.lock);
+    if(zswap.pages[pi].mem == 0){
+      release(&zswap.lock);
+      break;
+    }
+    h = pi * 32 + k;
+    if(!(zswap.pages[pi].used & (1 << k))){
+      release(&zswap.lock);
+      continue;
+    }
+    slot = zobj(h)->slot;
+    release(&zswap.lock);
+
+    // Keep the slot from being freed and reused while its
+    // contents are on their way to the disk.
+    if(!swap_trystart(slot))
+      continue;
+    acquire(&zswap.lock);
+    if(ztab[slot] == h + 1){
+      z = zobj(h);
+      if(lz_decompress((uchar*)(z + 1), z->len, (uchar*)wb) < 0)
+        panic("zswap: corrupt");
+      release(&zswap.lock);
+      swapwritev(&wb, 1, slot);
+      acquire(&zswap.lock);
+      if(ztab[slot] == h + 1){
+        ztab[slot] = 0;
+        zfree(h);
+        zswap.writeback++;
+      }
+    }
+    release(&zswap.lock);
+    swap_iodone(slot);
+  }
+
+  acquire(&zswap.lock);
+  zswap.wbbusy = 0;
+  release(&zswap.lock);
+}
+
+// Keep a compressed copy of page for swap slot slot instead of
+// writing it out.  Returns -1 if the page goes to disk after all.
+int
+zswap_store(int slot, char *page)
+{
+  struct zhdr *z;
+  int len, class, h, tries;
+  uint t;
+
+  for(tries = 0; tries < 2; tries++){
+    acquire(&zswap.lock);
+    if(zswap.maxpages == 0){
+      release(&zswap.lock);
+      return -1;
+    }
+    t = rdtsc();
+    len = lz_compress((uchar*)page, zswap.buf, ZMAXOBJ - sizeof(*z));
+    zswap.compkc += (rdtsc() - t) >> 10;
+    if(len < 0){
+      zswap.rejects++;
+      release(&zswap.lock);
+      return -1;
+    }
+    for(class = 0; (1 << (class + ZMINSHIFT)) < len + sizeof(*z); class++)
+      ;
+    if((h = zalloc(class)) >= 0){
+      if(ztab[slot])
+        zfree(ztab[slot] - 1);
+      z = zobj(h);
+      z->slot = slot;
+      z->len = len;
+      memmove(z + 1, zswap.buf, len);
+      ztab[slot] = h + 1;
+      zswap.stores++;
+      zswap.stored++;
+      zswap.bytes += len;
+      release(&zswap.lock);
+      return 0;
+    }
+    release(&zswap.lock);
+    if(tries == 0)
+      zswap_writeback();
+  }
+  return -1;
+}
+
+// Fill page from the pool copy of swap slot slot.
+// Returns -1 if the slot's contents are on disk.
+int
+zswap_load(int slot, char *page)
+{
+  struct zhdr *z;
+  uint t;
+
+  acquire(&zswap.lock);
+  if(ztab[slot] == 0){
+    if(zswap.maxpages)
+      zswap.misses++;
+    release(&zswap.lock);
+    return -1;
+  }
+  z = zobj(ztab[slot] - 1);
+  t = rdtsc();
+  if(lz_decompress((uchar*)(z + 1), z->len, (uchar*)page) < 0)
+    panic("zswap: corrupt");
+  zswap.decompkc += (rdtsc() - t) >> 10;
+  zswap.loads++;
+  release(&zswap.lock);
+  return 0;
+}
+
+// Is slot's data in the pool?  Only a hint, for readahead.
+int
+zswap_has(int slot)
+{
+  return ztab[slot] != 0;
+}
+
+// Drop the pool copy of slot, which is being freed.
+// Called with swaplock held.
+void
+zswap_invalidate(int slot)
+{
+  if(ztab[slot] == 0)
+    return;
+  acquire(&zswap.lock);
+  if(ztab[slot]){
+    zfree(ztab[slot] - 1);
+    ztab[slot] = 0;
+  }
+  release(&zswap.lock);
+}
+
+// Set the pool limit in pages, if val >= 0; 0 turns the tier off
+// for new pages.  Returns the old limit.
+int
+zswapctl(int val)
+{
+  int old;
+
+  acquire(&zswap.lock);
+  old = zswap.maxpages;
+  if(val >= 0)
+    zswap.maxpages = val < ZSWAPPAGES ? val : ZSWAPPAGES;
+  release(&zswap.lock);
+  return old;
+}
+
+void
+zswapstat(struct memstat *st)
+{
+  st->zswappages = zswap.npages;
+  st->zswapstored = zswap.stored;
+  st->zswapbytes = zswap.bytes;
+  st->zswapstores = zswap.stores;
+  st->zswaploads = zswap.loads;
+  st->zswapmisses = zswap.misses;
+  st->zswaprejects = zswap.rejects;
+  st->zswapwriteback = zswap.writeback;
+  st->zswapcompkc = zswap.compkc;
+  st->zswapdecompkc = zswap.decompkc;
+}